@@ -1,12 +1,30 @@
 #include "emc230x.h"
+#include "emc230x_regs.h"
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
+#include <esp_idf_version.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #define TIMEOUT_MS 35 // derived from SMBus
+#define PROBE_TIMEOUT_MS 5 // used when scanning
+#define SMBUS_MAX_HZ 100000
 
 static const char* TAG = "emc";
 
+// register names are only used for debug logging, and are compiled out
+// along with it.
+#ifdef CONFIG_EMC230X_REGISTER_LOGGING
+#define REGNAME(name) (name)
+#else
+#define REGNAME(name) NULL
+#endif
+
 #define EMC2301_ADDRESS   0x2f // emc2301
 #define EMC2302_1_ADDRESS 0x2e // emc2302-1
 #define EMC2302_2_ADDRESS 0x2f // emc2302-2 (same as emc2301)
@@ -35,228 +53,643 @@ check_selected_address(uint8_t address){
   return false;
 }
 
-// software locked registers cannot be modified unless the LOCK bit (LSB
-// of EMCREG_SOFTWARELOCK) is zero.
-typedef enum {
-  // configuration register is 0x40 on reset (DIS_TO set, MASK/WD_EN/DRESK/USECK unset)
-  EMCREG_CONFIGURATION = 0x20,      // software locked
-  EMCREG_FANSTATUS = 0x24,
-  EMCREG_STALLSTATUS = 0x25,
-  EMCREG_SPINSTATUS = 0x26,
-  EMCREG_DRIVESTATUS = 0x27,
-  EMCREG_FANINTR = 0x29,
-  EMCREG_PWMPOLARITY = 0x2a,
-  EMCREG_PWMOUTPUT = 0x2b,
-  EMCREG_PWMBASE45 = 0x2c,
-  EMCREG_PWMBASE123 = 0x2d,
-  EMCREG_FAN1SETTING = 0x30,
-  EMCREG_PWM1DIVIDE = 0x31,
-  EMCREG_FAN1CONF1 = 0x32,
-  EMCREG_FAN1CONF2 = 0x33,          // software locked
-  EMCREG_GAIN1 = 0x35,              // software locked
-  EMCREG_FAN1SPINUP = 0x36,         // software locked
-  EMCREG_FAN1MAXSTEP = 0x37,        // software locked
-  EMCREG_FAN1MINDRIVE = 0x38,       // software locked
-  EMCREG_FAN1FAILLOW = 0x3a,        // software locked
-  EMCREG_FAN1FAILHIGH = 0x3b,       // software locked
-  EMCREG_TACH1TARGLOW = 0x3c,
-  EMCREG_TACH1TARGHIGH = 0x3d,
-  EMCREG_TACH1READLOW = 0x3e,
-  EMCREG_TACH1READHIGH = 0x3f,
-  // fan2 registers are only supported on emc230[235]
-  EMCREG_FAN2SETTING = 0x40,
-  EMCREG_PWM2DIVIDE = 0x41,
-  EMCREG_FAN2CONF1 = 0x42,
-  EMCREG_FAN2CONF2 = 0x43,
-  EMCREG_GAIN2 = 0x45,
-  EMCREG_FAN2SPINUP = 0x46,
-  EMCREG_FAN2MAXSTEP = 0x47,
-  EMCREG_FAN2MINDRIVE = 0x48,
-  EMCREG_FAN2FAILLOW = 0x4a,
-  EMCREG_FAN2FAILHIGH = 0x4b,
-  EMCREG_TACH2TARGLOW = 0x4c,
-  EMCREG_TACH2TARGHIGH = 0x4d,
-  EMCREG_TACH2READLOW = 0x4e,
-  EMCREG_TACH2READHIGH = 0x4f,
-  // fan3 registers are only supported on emc230[35]
-  EMCREG_FAN3SETTING = 0x50,
-  EMCREG_PWM3DIVIDE = 0x51,
-  EMCREG_FAN3CONF1 = 0x52,
-  EMCREG_FAN3CONF2 = 0x53,
-  EMCREG_GAIN3 = 0x55,
-  EMCREG_FAN3SPINUP = 0x56,
-  EMCREG_FAN3MAXSTEP = 0x57,
-  EMCREG_FAN3MINDRIVE = 0x58,
-  EMCREG_FAN3FAILLOW = 0x5a,
-  EMCREG_FAN3FAILHIGH = 0x5b,
-  EMCREG_TACH3TARGLOW = 0x5c,
-  EMCREG_TACH3TARGHIGH = 0x5d,
-  EMCREG_TACH3READLOW = 0x5e,
-  EMCREG_TACH3READHIGH = 0x5f,
-  // fan4 and fan5 registers are only supported on emc2305
-  EMCREG_FAN4SETTING = 0x60,
-  EMCREG_PWM4DIVIDE = 0x61,
-  EMCREG_FAN4CONF1 = 0x62,
-  EMCREG_FAN4CONF2 = 0x63,
-  EMCREG_GAIN4 = 0x65,
-  EMCREG_FAN4SPINUP = 0x66,
-  EMCREG_FAN4MAXSTEP = 0x67,
-  EMCREG_FAN4MINDRIVE = 0x68,
-  EMCREG_FAN4FAILLOW = 0x6a,
-  EMCREG_FAN4FAILHIGH = 0x6b,
-  EMCREG_TACH4TARGLOW = 0x6c,
-  EMCREG_TACH4TARGHIGH = 0x6d,
-  EMCREG_TACH4READLOW = 0x6e,
-  EMCREG_TACH4READHIGH = 0x6f,
-  EMCREG_FAN5SETTING = 0x70,
-  EMCREG_PWM5DIVIDE = 0x71,
-  EMCREG_FAN5CONF1 = 0x72,
-  EMCREG_FAN5CONF2 = 0x73,
-  EMCREG_GAIN5 = 0x75,
-  EMCREG_FAN5SPINUP = 0x76,
-  EMCREG_FAN5MAXSTEP = 0x77,
-  EMCREG_FAN5MINDRIVE = 0x78,
-  EMCREG_FAN5FAILLOW = 0x7a,
-  EMCREG_FAN5FAILHIGH = 0x7b,
-  EMCREG_TACH5TARGLOW = 0x7c,
-  EMCREG_TACH5TARGHIGH = 0x7d,
-  EMCREG_TACH5READLOW = 0x7e,
-  EMCREG_TACH5READHIGH = 0x7f,
-  EMCREG_SOFTWARELOCK = 0xef,     // when set, some registers become readonly
-  EMCREG_PRODFEATURES = 0xfc,     // only supported on emc230[35]
-  EMCREG_PRODUCT = 0xfd,          // ought be some EMCPRODUCTID_230x value
-  EMCREG_MANUFACTURER = 0xfe,     // ought be EMCMANUFACTURERID
-  EMCREG_REVISION = 0xff,
-} emcreg_e;
-
 #define EMCPRODUCTID_2301 0x37
 #define EMCPRODUCTID_2302 0x36
 #define EMCPRODUCTID_2303 0x35
 #define EMCPRODUCTID_2305 0x34
 #define EMCMANUFACTURERID 0x5d
 
-// get the single byte of some register into *val and returning 0.
-// returns -1 on failure.
-static inline int
-emc230x_readreg(i2c_master_dev_handle_t i2c, emcreg_e reg,
-                const char* regname, uint8_t* val){
-  uint8_t r = reg;
-  esp_err_t e;
-  if((e = i2c_master_transmit_receive(i2c, &r, 1, val, 1, TIMEOUT_MS)) != ESP_OK){
-    ESP_LOGE(TAG, "error (%s) requesting %s via I2C", esp_err_to_name(e), regname);
+// supported models, per Kconfig. a configuration lacking our options
+// entirely (e.g. an sdkconfig.h from outside the component) gets all of
+// them.
+#ifndef CONFIG_EMC230X_MAX_FANS
+#define CONFIG_EMC230X_SUPPORT_EMC2301 1
+#define CONFIG_EMC230X_SUPPORT_EMC2302 1
+#define CONFIG_EMC230X_SUPPORT_EMC2303 1
+#define CONFIG_EMC230X_SUPPORT_EMC2305 1
+#endif
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2301
+#define EMC_HAS_2301 1
+#else
+#define EMC_HAS_2301 0
+#endif
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2302
+#define EMC_HAS_2302 1
+#else
+#define EMC_HAS_2302 0
+#endif
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2303
+#define EMC_HAS_2303 1
+#else
+#define EMC_HAS_2303 0
+#endif
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2305
+#define EMC_HAS_2305 1
+#else
+#define EMC_HAS_2305 0
+#endif
+#define EMC_MODELS (EMC_HAS_2301 + EMC_HAS_2302 + EMC_HAS_2303 + EMC_HAS_2305)
+#if EMC_MODELS == 0
+#error "no EMC230x models are supported; check CONFIG_EMC230X_SUPPORT_*"
+#endif
+// with a single model supported, this is its fan count
+#define EMC_ONLY_FANS (EMC_HAS_2301 + 2 * EMC_HAS_2302 + 3 * EMC_HAS_2303 + 5 * EMC_HAS_2305)
+
+// CONFIGURATION fields
+#define EMC_CONFIG_DIS_TO 0x40u
+
+// FANxCONF1 fields
+#define EMC_CONF1_EN_ALGO     0x80u
+#define EMC_CONF1_RANGE_SHIFT 5u
+#define EMC_CONF1_RANGE       (0x3u << EMC_CONF1_RANGE_SHIFT)
+#define EMC_CONF1_EDGES_SHIFT 3u
+#define EMC_CONF1_EDGES       (0x3u << EMC_CONF1_EDGES_SHIFT)
+#define EMC_CONF1_UPDATE      0x07u
+
+// FANxCONF2 fields
+#define EMC_CONF2_EN_RRC        0x40u
+#define EMC_CONF2_DER_OPT_SHIFT 3u
+#define EMC_CONF2_DER_OPT       (0x3u << EMC_CONF2_DER_OPT_SHIFT)
+#define EMC_CONF2_ERR_RNG_SHIFT 1u
+#define EMC_CONF2_ERR_RNG       (0x3u << EMC_CONF2_ERR_RNG_SHIFT)
+
+// FANxSPINUP fields
+#define EMC_SPINUP_DRIVE_FAIL_CNT_SHIFT 6u
+#define EMC_SPINUP_NOKICK               0x20u
+#define EMC_SPINUP_SPIN_LVL_SHIFT       2u
+
+// FANxMAXSTEP is a 6-bit field
+#define EMC_MAXSTEP_MAX 0x3fu
+
+// the largest tach count, indicating a stopped fan
+#define EMC_TACH_MAX 0x1fffu
+
+// timestamp for emc230x_record(), avoiding the clock when not collecting.
+static inline int64_t
+stats_now(void){
+#ifdef CONFIG_EMC230X_STATS
+  return esp_timer_get_time();
+#else
+  return 0;
+#endif
+}
+
+// account an operation of class op which moved bytes (excluding address
+// bytes) and began at t0, completing with e. the statistics are not
+// synchronized; tasks sharing a device might occasionally lose counts.
+static void
+emc230x_record(const emc230x* emc, emc230x_op op, size_t bytes, int64_t t0, esp_err_t e){
+#ifdef CONFIG_EMC230X_STATS
+  emc230x_stats* st = &((emc230x*)emc)->stats;
+  emc230x_opstats* os = &st->ops[op];
+  const uint32_t us = esp_timer_get_time() - t0;
+  if(os->transactions++ == 0 || us < os->min_us){
+    os->min_us = us;
+  }
+  if(us > os->max_us){
+    os->max_us = us;
+  }
+  os->total_us += us;
+  os->bytes += bytes;
+  unsigned b = 0;
+  while(b < EMC230X_LATENCY_BUCKETS - 1 && us >= (EMC230X_LATENCY_BUCKET0_US << b)){
+    ++b;
+  }
+  ++os->latency[b];
+  if(e == ESP_OK){
+    return;
+  }
+  ++os->errors;
+  if(e == ESP_ERR_TIMEOUT){
+    ++os->timeouts;
+  }
+  for(unsigned i = 0 ; i < EMC230X_STATS_ERRCODES ; ++i){
+    if(st->errcodes[i].count == 0){
+      st->errcodes[i].code = e;
+    }
+    if(st->errcodes[i].code == e){
+      ++st->errcodes[i].count;
+      return;
+    }
+  }
+  ++st->othererrors;
+#else
+  (void)emc; (void)op; (void)bytes; (void)t0; (void)e;
+#endif
+}
+
+// the cause of a failure in the driver
+static emc230x_error
+classify(esp_err_t e){
+  switch(e){
+    case ESP_OK:
+      return EMC230X_ERR_NONE;
+    case ESP_ERR_TIMEOUT:
+      return EMC230X_ERR_TIMEOUT;
+    case ESP_ERR_INVALID_STATE:     // NACK, in older drivers
+    case ESP_ERR_INVALID_RESPONSE:
+    case ESP_ERR_NOT_FOUND:
+      return EMC230X_ERR_NACK;
+  }
+  return EMC230X_ERR_BUS;
+}
+
+// a single I2C transaction, in one of the forms the driver accepts
+typedef struct emcxfer {
+  const uint8_t* wbuf;
+  size_t wlen;
+  uint8_t* rbuf;                // NULL for a write
+  size_t rlen;
+#ifdef EMC230X_DEFINED_OPS
+  i2c_operation_job_t* ops;     // if non-NULL, used in place of the above
+  size_t opcount;
+#endif
+} emcxfer;
+
+// on a bus in asynchronous mode, the driver returns as soon as a
+// transaction is queued, reporting its outcome to our device handle's
+// callback. the handle is shared by any number of tasks (the sampler, the
+// queue worker, the alert task, and direct callers), so issuing and
+// waiting is serialized by lock. a device's transactions complete in
+// order, so each is tagged with a sequence number, and a completion is
+// ours only once completed reaches our tag; an earlier one belongs to a
+// transaction we gave up on.
+struct emc230x_xferwait {
+  SemaphoreHandle_t lock;       // held from issue through completion
+  SemaphoreHandle_t done;       // given upon each completion
+  volatile unsigned issued;     // tag of the latest transaction issued
+  volatile unsigned completed;  // tag of the latest transaction completed
+  volatile esp_err_t result;    // outcome of the latest completion
+};
+
+static bool
+xfer_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t* evt, void* arg){
+  (void)dev;
+  struct emc230x_xferwait* w = arg;
+  // with nothing outstanding, this completes a transaction abandoned to a
+  // bus reset, and there's no one to deliver it to
+  if(w->completed == w->issued){
+    return false;
+  }
+  switch(evt->event){
+    case I2C_EVENT_DONE:
+      w->result = ESP_OK;
+      break;
+    case I2C_EVENT_NACK:
+      w->result = ESP_ERR_INVALID_RESPONSE;
+      break;
+    case I2C_EVENT_TIMEOUT:
+      w->result = ESP_ERR_TIMEOUT;
+      break;
+    default:
+      return false; // still in progress
+  }
+  ++w->completed;
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(w->done, &woken);
+  return woken == pdTRUE;
+}
+
+// set up emc->xferwait if the bus is in asynchronous mode. emc->i2c must
+// already be set up.
+static int
+xferwait_init(emc230x* emc, bool async_bus){
+  emc->xferwait = NULL;
+  if(!async_bus){
+    return 0;
+  }
+  struct emc230x_xferwait* w = calloc(1, sizeof(*w));
+  if(w == NULL || (w->done = xSemaphoreCreateBinary()) == NULL){
+    ESP_LOGE(TAG, "couldn't allocate transaction completion");
+    free(w);
+    return -1;
+  }
+  if((w->lock = xSemaphoreCreateMutex()) == NULL){
+    ESP_LOGE(TAG, "couldn't allocate transaction lock");
+    vSemaphoreDelete(w->done);
+    free(w);
     return -1;
   }
-  ESP_LOGD(TAG, "got %s: 0x%02x", regname, *val);
+  const i2c_master_event_callbacks_t cbs = {
+    .on_trans_done = xfer_done,
+  };
+  esp_err_t e = i2c_master_register_event_callbacks(emc->i2c, &cbs, w);
+  if(e != ESP_OK){
+    ESP_LOGE(TAG, "error (%s) registering completion callback", esp_err_to_name(e));
+    vSemaphoreDelete(w->lock);
+    vSemaphoreDelete(w->done);
+    free(w);
+    return -1;
+  }
+  emc->xferwait = w;
   return 0;
 }
 
-static inline int
-emc230x_manufacturer(i2c_master_dev_handle_t i2c, uint8_t* val){
-  return emc230x_readreg(i2c, EMCREG_MANUFACTURER, "ManufacturerID", val);
+static void
+xferwait_free(emc230x* emc){
+  if(emc->xferwait){
+    vSemaphoreDelete(emc->xferwait->lock);
+    vSemaphoreDelete(emc->xferwait->done);
+    free(emc->xferwait);
+    emc->xferwait = NULL;
+  }
+}
+
+static esp_err_t
+xfer_issue(const emc230x* emc, const emcxfer* x){
+#ifdef EMC230X_DEFINED_OPS
+  if(x->ops){
+    return i2c_master_execute_defined_operations(emc->i2c, x->ops, x->opcount, emc->timeout_ms);
+  }
+#endif
+  if(x->rbuf){
+    return i2c_master_transmit_receive(emc->i2c, x->wbuf, x->wlen, x->rbuf, x->rlen, emc->timeout_ms);
+  }
+  return i2c_master_transmit(emc->i2c, x->wbuf, x->wlen, emc->timeout_ms);
+}
+
+// wait for the completion of the transaction tagged tag. the buffers live
+// in our caller's frame, so we mustn't return while the driver might still
+// use them. other devices' transactions might be queued ahead of ours; if
+// the completion hasn't arrived within our timeout, wait (as long again)
+// for the bus to drain. should that fail too, the bus is reset, abandoning
+// the transaction.
+static esp_err_t
+xfer_wait(const emc230x* emc, struct emc230x_xferwait* w, unsigned tag){
+  const TickType_t ticks = pdMS_TO_TICKS(emc->timeout_ms);
+  // completions preceding ours are late ones for abandoned transactions
+  while(w->completed != tag){
+    if(xSemaphoreTake(w->done, ticks) != pdTRUE){
+      break;
+    }
+  }
+  if(w->completed == tag){
+    return w->result;
+  }
+  esp_err_t e = i2c_master_bus_wait_all_done(emc->bus, emc->timeout_ms);
+  if(e == ESP_OK && w->completed == tag){
+    return w->result;
+  }
+  ESP_LOGE(TAG, "transaction at 0x%02x never completed, resetting bus", emc->address);
+  if((e = i2c_master_bus_reset(emc->bus)) != ESP_OK){
+    ESP_LOGE(TAG, "error (%s) resetting I2C bus", esp_err_to_name(e));
+  }
+  w->completed = tag;
+  return ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t
+xfer_once(const emc230x* emc, const emcxfer* x){
+  struct emc230x_xferwait* w = emc->xferwait;
+  if(w == NULL){
+    return xfer_issue(emc, x);
+  }
+  xSemaphoreTake(w->lock, portMAX_DELAY);
+  const unsigned tag = w->issued + 1;
+  // publish the tag before issuing, since the transaction might complete
+  // before the driver returns
+  w->issued = tag;
+  esp_err_t e = xfer_issue(emc, x);
+  if(e != ESP_OK){
+    w->completed = tag; // nothing will complete it
+  }else{
+    e = xfer_wait(emc, w, tag);
+  }
+  xSemaphoreGive(w->lock);
+  return e;
+}
+
+// perform x subject to the retry policy and circuit breaker, accounting
+// each attempt as an operation of class op moving bytes. like the
+// statistics, the health state is updated through const handles, and is
+// not synchronized.
+static esp_err_t
+emc230x_transfer(const emc230x* emc, emc230x_op op, size_t bytes, const emcxfer* x){
+  emc230x* m = (emc230x*)emc;
+  emc230x_health* h = &m->health;
+  const emc230x_retry_policy* p = &emc->retry;
+  const int64_t start = esp_timer_get_time();
+  // an open breaker fails everything until its cooldown has passed, and
+  // then allows a single attempt through to probe the device.
+  bool trial = false;
+  if(h->open){
+    if(start < h->reopen_us){
+      ++h->fastfails;
+      m->lasterr = EMC230X_ERR_UNAVAILABLE;
+      return ESP_ERR_INVALID_STATE;
+    }
+    trial = true;
+  }
+  const unsigned attempts = trial || p->attempts == 0 ? 1 : p->attempts;
+  esp_err_t e;
+  for(unsigned a = 1 ; ; ++a){
+    const int64_t t0 = stats_now();
+    e = xfer_once(emc, x);
+    emc230x_record(emc, op, bytes, t0, e);
+    if(e == ESP_OK){
+      h->consecutive = 0;
+      h->timeouts = 0;
+      if(h->open){
+        ESP_LOGI(TAG, "device at 0x%02x recovered", emc->address);
+        h->open = false;
+      }
+      return ESP_OK;
+    }
+    const emc230x_error err = classify(e);
+    m->lasterr = err;
+    // a wedged bus (typically a slave holding SDA low) shows up as a run of
+    // timeouts, and is freed by clocking it out.
+    if(err == EMC230X_ERR_TIMEOUT && p->reset_after && ++h->timeouts >= p->reset_after){
+      ESP_LOGW(TAG, "%u consecutive timeouts, resetting bus", h->timeouts);
+      h->timeouts = 0;
+      ++h->busresets;
+      esp_err_t re = i2c_master_bus_reset(emc->bus);
+      if(re != ESP_OK){
+        ESP_LOGE(TAG, "error (%s) resetting bus", esp_err_to_name(re));
+      }
+    }
+    if(a >= attempts || (err != EMC230X_ERR_TIMEOUT && err != EMC230X_ERR_NACK)){
+      break;
+    }
+    const unsigned backoff = p->backoff_ms << (a - 1);
+    if(p->deadline_ms && esp_timer_get_time() + backoff * 1000ll - start >= p->deadline_ms * 1000ll){
+      break;
+    }
+    ++h->retries;
+    if(backoff){
+      vTaskDelay(pdMS_TO_TICKS(backoff));
+    }
+  }
+  if(trial || (p->trip_after && ++h->consecutive >= p->trip_after)){
+    if(!h->open){
+      ESP_LOGW(TAG, "device at 0x%02x unhealthy, failing fast for %ums", emc->address, p->cooldown_ms);
+      ++h->trips;
+    }
+    h->open = true;
+    h->consecutive = 0;
+    h->reopen_us = esp_timer_get_time() + p->cooldown_ms * 1000ll;
+  }
+  return e;
+}
+
+// a transaction refused by the open breaker, which logged once upon
+// opening, and ought not log again for each refusal
+static inline bool
+fastfailed(const emc230x* emc){
+  return emc->lasterr == EMC230X_ERR_UNAVAILABLE;
+}
+
+// read len consecutive registers starting at reg into val, using a single
+// transaction (the device auto-increments its register pointer through a
+// block read). returns 0 on success, -1 on failure.
+static int
+emc230x_readregs(const emc230x* emc, emcreg_e reg,
+                 const char* regname, uint8_t* val, size_t len){
+  uint8_t r = reg;
+  const emcxfer x = { .wbuf = &r, .wlen = 1, .rbuf = val, .rlen = len, };
+  esp_err_t e = emc230x_transfer(emc, EMC230X_OP_READ, 1 + len, &x);
+  if(e != ESP_OK){
+    if(!fastfailed(emc)){
+      ESP_LOGE(TAG, "error (%s) requesting %zuB at 0x%02x via I2C", esp_err_to_name(e), len, r);
+    }
+    return -1;
+  }
+#ifdef CONFIG_EMC230X_REGISTER_LOGGING
+  ESP_LOGD(TAG, "got %zuB of %s: 0x%02x...", len, regname, *val);
+#else
+  (void)regname;
+#endif
+  return 0;
 }
 
+// get the single byte of some register into *val and returning 0.
+// returns -1 on failure.
 static inline int
-emc230x_product(i2c_master_dev_handle_t i2c, uint8_t* val){
-  return emc230x_readreg(i2c, EMCREG_PRODUCT, "ProductID", val);
+emc230x_readreg(const emc230x* emc, emcreg_e reg,
+                const char* regname, uint8_t* val){
+  return emc230x_readregs(emc, reg, regname, val, 1);
 }
 
 static int
-emc230x_xmit(i2c_master_dev_handle_t i2c, const void* buf, size_t blen){
-  esp_err_t e = i2c_master_transmit(i2c, buf, blen, TIMEOUT_MS);
+emc230x_xmit(const emc230x* emc, const void* buf, size_t blen){
+  const emcxfer x = { .wbuf = buf, .wlen = blen, };
+  esp_err_t e = emc230x_transfer(emc, EMC230X_OP_WRITE, blen, &x);
   if(e != ESP_OK){
-    ESP_LOGE(TAG, "error %d transmitting %zuB via I2C", e, blen);
+    if(!fastfailed(emc)){
+      ESP_LOGE(TAG, "error (%s) transmitting %zuB via I2C", esp_err_to_name(e), blen);
+    }
+    return -1;
+  }
+  return 0;
+}
+
+#ifdef EMC230X_DEFINED_OPS
+int emc230x_execute_ops(const emc230x* emc, i2c_operation_job_t* ops,
+                        size_t opcount, size_t bytes){
+  const emcxfer x = { .ops = ops, .opcount = opcount, };
+  esp_err_t e = emc230x_transfer(emc, EMC230X_OP_CHAINED, bytes, &x);
+  if(e != ESP_OK){
+    if(!fastfailed(emc)){
+      ESP_LOGE(TAG, "error (%s) executing %zu chained operations via I2C",
+               esp_err_to_name(e), opcount);
+    }
     return -1;
   }
   return 0;
 }
+#endif
 
 static inline int
-emc230x_set_softwarelock(i2c_master_dev_handle_t i2c, bool lock){
+emc230x_set_softwarelock(const emc230x* emc, bool lock){
   uint8_t buf[] = {
     EMCREG_SOFTWARELOCK,
     lock
   };
-  return emc230x_xmit(i2c, buf, sizeof(buf));
+  return emc230x_xmit(emc, buf, sizeof(buf));
 }
 
-// unlock the software lock, write the payload, and lock it back up
+// stage the write of val to reg in the open configuration batch, replacing
+// any earlier staged write to the same register.
 static int
-emc230x_xmit_locked(i2c_master_dev_handle_t i2c, const void* buf, size_t blen){
-  if(emc230x_set_softwarelock(i2c, false)){
+emc230x_stage(emc230x* emc, uint8_t reg, uint8_t val){
+  for(unsigned i = 0 ; i < emc->batchcount ; ++i){
+    if(emc->batch[i][0] == reg){
+      emc->batch[i][1] = val;
+      return 0;
+    }
+  }
+  if(emc->batchcount == EMC230X_BATCH_MAX){
+    ESP_LOGE(TAG, "configuration batch full (%u writes)", emc->batchcount);
+    emc->batchfailed = true;
+    return -1;
+  }
+  emc->batch[emc->batchcount][0] = reg;
+  emc->batch[emc->batchcount][1] = val;
+  ++emc->batchcount;
+  return 0;
+}
+
+// unlock the software lock, write val to reg, and lock it back up. if a
+// configuration batch is open, the write is instead staged for the commit.
+static int
+emc230x_xmit_locked(emc230x* emc, uint8_t reg, uint8_t val){
+  if(emc->batching){
+    return emc230x_stage(emc, reg, val);
+  }
+  uint8_t buf[] = { reg, val, };
+  if(emc230x_set_softwarelock(emc, false)){
     return -1;
   }
-  if(emc230x_xmit(i2c, buf, blen)){
+  if(emc230x_xmit(emc, buf, sizeof(buf))){
     return -1;
   }
-  if(emc230x_set_softwarelock(i2c, true)){
+  if(emc230x_set_softwarelock(emc, true)){
     return -1;
   }
   return 0;
 }
 
-// probe for an emc230[1235] at the specified address. only considered a
-// success upon verification of the expected product ID.
+// read the product, manufacturer, and revision IDs (0xfd..0xff) in a
+// single transfer. returns -1 on a bus error, or if the manufacturer ID
+// doesn't match; otherwise the product ID is returned.
 static int
-emc230x_mod_detect(i2c_master_bus_handle_t i2c, emc230x* emc,
-                   uint8_t addr, uint8_t productid){
-  esp_err_t e = i2c_master_probe(i2c, addr, TIMEOUT_MS);
-  if(e != ESP_OK){
-    ESP_LOGI(TAG, "no probe response at 0x%02x", addr);
+emc230x_read_ids(const emc230x* emc){
+  uint8_t ids[EMCREG_REVISION - EMCREG_PRODUCT + 1];
+  if(emc230x_readregs(emc, EMCREG_PRODUCT, REGNAME("ProductIDs"), ids, sizeof(ids))){
+    return -1;
+  }
+  if(ids[EMCREG_MANUFACTURER - EMCREG_PRODUCT] != EMCMANUFACTURERID){
+    ESP_LOGW(TAG, "unexpected manufacturer ID 0x%02x", ids[EMCREG_MANUFACTURER - EMCREG_PRODUCT]);
     return -1;
   }
-  ESP_LOGI(TAG, "got probe response at 0x%02x, checking for emc230x", addr);
+  ESP_LOGI(TAG, "product 0x%02x revision 0x%02x", ids[0], ids[EMCREG_REVISION - EMCREG_PRODUCT]);
+  return ids[0];
+}
+
+// initialize the remainder of emc (i2c must already be set up) for the
+// device at addr with the verified productid.
+static int
+emc230x_init(emc230x* emc, uint8_t addr, uint8_t productid){
+  emc->address = addr;
+  emc->productid = productid;
+  emc->batching = false;
+  emc->batchcount = 0;
+  emc->tachstats = NULL;
+  emc->autorange = 0;
+  memset(&emc->cache, 0, sizeof(emc->cache));
+  for(unsigned i = 0 ; i < EMC230X_MAXFANS ; ++i){
+    emc->poles[i] = 2;
+  }
+  return emc230x_resync(emc);
+}
+
+// by default, each transaction is attempted once, and the bus is never
+// reset nor the breaker tripped, as before policies existed.
+static const emc230x_retry_policy default_policy = {
+  .attempts = 1,
+};
+
+// reset the retry policy and health of a handle being set up, prior to
+// its first I2C access.
+static void
+init_health(emc230x* emc){
+  emc->retry = default_policy;
+  memset(&emc->health, 0, sizeof(emc->health));
+  emc->lasterr = EMC230X_ERR_NONE;
+}
+
+static int
+emc230x_add_device(i2c_master_bus_handle_t i2c, uint8_t addr, uint32_t scl_hz,
+                   i2c_master_dev_handle_t* dev){
   i2c_device_config_t devcfg = {
     .dev_addr_length = I2C_ADDR_BIT_LEN_7,
     .device_address = addr,
-    .scl_speed_hz = 100000,
-	};
-  if((e = i2c_master_bus_add_device(i2c, &devcfg, &emc->i2c)) != ESP_OK){
+    .scl_speed_hz = scl_hz,
+  };
+  esp_err_t e;
+  if((e = i2c_master_bus_add_device(i2c, &devcfg, dev)) != ESP_OK){
     ESP_LOGE(TAG, "error (%s) adding i2c device at 0x%02x", esp_err_to_name(e), addr);
     return -1;
   }
-  uint8_t regv;
-  if(emc230x_manufacturer(emc->i2c, &regv) == 0){
-    if(regv == EMCMANUFACTURERID){
-      if(emc230x_product(emc->i2c, &regv) == 0){
-        if(regv == productid){
-          emc->address = addr;
-          emc->productid = productid;
-          return 0;
-        }
-      }
+  return 0;
+}
+
+static void
+emc230x_rm_device(i2c_master_dev_handle_t dev, uint8_t addr){
+  esp_err_t e;
+  if((e = i2c_master_bus_rm_device(dev)) != ESP_OK){
+    ESP_LOGW(TAG, "error (%s) removing i2c device at 0x%02x", esp_err_to_name(e), addr);
+  }
+}
+
+// probe for an emc230[1235] at the specified address. only considered a
+// success upon verification of the expected product ID.
+static int
+emc230x_mod_detect(i2c_master_bus_handle_t i2c, emc230x* emc,
+                   uint8_t addr, uint8_t productid,
+                   const emc230x_options* opts){
+  // an absent device will fail the ID read anyway, so the probe can be
+  // skipped to save a transaction. it is always skipped on an asynchronous
+  // bus, where only our own transactions wait for completion.
+  if(!opts->skip_probe && !opts->async_bus){
+    esp_err_t e = i2c_master_probe(i2c, addr, opts->probe_timeout_ms);
+    if(e != ESP_OK){
+      ESP_LOGI(TAG, "no probe response at 0x%02x", addr);
+      return -1;
+    }
+    ESP_LOGI(TAG, "got probe response at 0x%02x, checking for emc230x", addr);
+  }
+  if(emc230x_add_device(i2c, addr, opts->scl_speed_hz, &emc->i2c)){
+    return -1;
+  }
+  emc->bus = i2c;
+  emc->scl_speed_hz = opts->scl_speed_hz;
+  emc->timeout_ms = opts->timeout_ms;
+  emc230x_reset_stats(emc);
+  init_health(emc);
+  if(xferwait_init(emc, opts->async_bus)){
+    emc230x_rm_device(emc->i2c, addr);
+    return -1;
+  }
+  if(emc230x_read_ids(emc) == productid){
+    if(emc230x_init(emc, addr, productid) == 0){
+      return 0;
     }
   }
   ESP_LOGE(TAG, "device at 0x%02x responded with unexpected data", addr);
   // the device didn't respond with the expected manufacturer/product ID.
   // remove it from the i2c bus master and return -1.
-  if((e = i2c_master_bus_rm_device(emc->i2c)) != ESP_OK){
-    ESP_LOGW(TAG, "error (%s) removing i2c device at 0x%02x", esp_err_to_name(e), addr);
-  }
+  emc230x_rm_device(emc->i2c, addr);
+  xferwait_free(emc);
   return -1;
 }
 
 // on success, emc is initialized and 0 is returned.
 static int
-emc230x_detect_addr(i2c_master_bus_handle_t i2c, emc230x_model model, uint8_t addr, emc230x* emc){
+emc230x_detect_addr(i2c_master_bus_handle_t i2c, emc230x_model model, uint8_t addr,
+                    const emc230x_options* opts, emc230x* emc){
   switch(model){
+#if EMC_HAS_2301
     case EMC2301:
       if(addr && addr != EMC2301_ADDRESS){
         ESP_LOGE(TAG, "invalid address %u for emc2301", addr);
         return -1;
       }
-      if(emc230x_mod_detect(i2c, emc, EMC2301_ADDRESS, EMCPRODUCTID_2301) == 0){
+      if(emc230x_mod_detect(i2c, emc, EMC2301_ADDRESS, EMCPRODUCTID_2301, opts) == 0){
         return 0;
       }
       break;
+#endif
+#if EMC_HAS_2302
     case EMC2302_MODEL_UNSPEC:
       if(addr){ // should not be specified for unknown emc2302
         ESP_LOGE(TAG, "invalid address %u for emc2302", addr);
         return -1;
       }
-      if(emc230x_mod_detect(i2c, emc, EMC2302_1_ADDRESS, EMCPRODUCTID_2302) == 0){
+      if(emc230x_mod_detect(i2c, emc, EMC2302_1_ADDRESS, EMCPRODUCTID_2302, opts) == 0){
         return 0;
       }
-      if(emc230x_mod_detect(i2c, emc, EMC2302_2_ADDRESS, EMCPRODUCTID_2302) == 0){
+      if(emc230x_mod_detect(i2c, emc, EMC2302_2_ADDRESS, EMCPRODUCTID_2302, opts) == 0){
         return 0;
       }
       break;
@@ -265,7 +698,7 @@ emc230x_detect_addr(i2c_master_bus_handle_t i2c, emc230x_model model, uint8_t ad
         ESP_LOGE(TAG, "invalid address %u for emc2302m1", addr);
         return -1;
       }
-      if(emc230x_mod_detect(i2c, emc, EMC2302_1_ADDRESS, EMCPRODUCTID_2302) == 0){
+      if(emc230x_mod_detect(i2c, emc, EMC2302_1_ADDRESS, EMCPRODUCTID_2302, opts) == 0){
         return 0;
       }
       break;
@@ -274,10 +707,12 @@ emc230x_detect_addr(i2c_master_bus_handle_t i2c, emc230x_model model, uint8_t ad
         ESP_LOGE(TAG, "invalid address %u for emc2302m2", addr);
         return -1;
       }
-      if(emc230x_mod_detect(i2c, emc, EMC2302_2_ADDRESS, EMCPRODUCTID_2302) == 0){
+      if(emc230x_mod_detect(i2c, emc, EMC2302_2_ADDRESS, EMCPRODUCTID_2302, opts) == 0){
         return 0;
       }
       break;
+#endif
+#if EMC_HAS_2303
     case EMC2303:
       if(!addr){
         addr = EMC2303_ADDRESS;
@@ -285,10 +720,12 @@ emc230x_detect_addr(i2c_master_bus_handle_t i2c, emc230x_model model, uint8_t ad
         ESP_LOGE(TAG, "invalid address %u for emc2303", addr);
         return -1;
       }
-      if(emc230x_mod_detect(i2c, emc, addr, EMCPRODUCTID_2303) == 0){
+      if(emc230x_mod_detect(i2c, emc, addr, EMCPRODUCTID_2303, opts) == 0){
         return 0;
       }
       break;
+#endif
+#if EMC_HAS_2305
     case EMC2305:
       if(!addr){
         addr = EMC2303_ADDRESS;
@@ -296,16 +733,29 @@ emc230x_detect_addr(i2c_master_bus_handle_t i2c, emc230x_model model, uint8_t ad
         ESP_LOGE(TAG, "invalid address %u for emc2305", addr);
         return -1;
       }
-      if(emc230x_mod_detect(i2c, emc, addr, EMCPRODUCTID_2305) == 0){
+      if(emc230x_mod_detect(i2c, emc, addr, EMCPRODUCTID_2305, opts) == 0){
         return 0;
       }
       break;
+#endif
+    default:
+      ESP_LOGE(TAG, "model %d not supported by this build", model);
+      break;
   }
   return -1;
 }
 
+static const emc230x_options default_options = {
+  .scl_speed_hz = 100000,
+  .timeout_ms = TIMEOUT_MS,
+  .probe_timeout_ms = TIMEOUT_MS,
+  .skip_probe = false,
+  .smbus_timeout = false,
+  .async_bus = false,
+};
+
 int emc230x_detect(i2c_master_bus_handle_t i2c, emc230x_model model, emc230x* emc){
-  if(emc230x_detect_addr(i2c, model, 0, emc)){
+  if(emc230x_detect_addr(i2c, model, 0, &default_options, emc)){
     ESP_LOGE(TAG, "error detecting EMC230x");
     return -1;
   }
@@ -316,7 +766,7 @@ int emc230x_detect(i2c_master_bus_handle_t i2c, emc230x_model model, emc230x* em
 int emc230x_detect_at_address(i2c_master_bus_handle_t i2c,
                               emc230x_model model, uint8_t address,
                               emc230x* emc){
-  if(emc230x_detect_addr(i2c, model, address, emc)){
+  if(emc230x_detect_addr(i2c, model, address, &default_options, emc)){
     ESP_LOGE(TAG, "error detecting EMC230x");
     return -1;
   }
@@ -324,164 +774,695 @@ int emc230x_detect_at_address(i2c_master_bus_handle_t i2c,
   return 0;
 }
 
+int emc230x_detect_opts(i2c_master_bus_handle_t i2c, emc230x_model model,
+                        uint8_t address, const emc230x_options* opts,
+                        emc230x* emc){
+  emc230x_options o = *opts;
+  if(o.scl_speed_hz == 0){
+    o.scl_speed_hz = default_options.scl_speed_hz;
+  }
+  if(o.timeout_ms == 0){
+    o.timeout_ms = default_options.timeout_ms;
+  }
+  if(o.probe_timeout_ms == 0){
+    o.probe_timeout_ms = o.timeout_ms;
+  }
+  // the SMBus timeout would reset the device's interface during normal
+  // operation at speeds beyond SMBus' 100 kHz.
+  if(o.smbus_timeout && o.scl_speed_hz > SMBUS_MAX_HZ){
+    ESP_LOGE(TAG, "SMBus timeout can't be used at %" PRIu32 " Hz", o.scl_speed_hz);
+    return -1;
+  }
+  if(emc230x_detect_addr(i2c, model, address, &o, emc)){
+    ESP_LOGE(TAG, "error detecting EMC230x");
+    return -1;
+  }
+  const bool enabled = !(emc->shadow.configuration & EMC_CONFIG_DIS_TO);
+  if(enabled != o.smbus_timeout){
+    if(emc230x_set_timeout(emc, o.smbus_timeout)){
+      emc230x_destroy(emc);
+      return -1;
+    }
+  }
+  ESP_LOGI(TAG, "successfully detected EMC230x at 0x%02x (%" PRIu32 " Hz)",
+           emc->address, emc->scl_speed_hz);
+  return 0;
+}
+
+// the number of fans of a supported product, or 0 if the product is not
+// supported by this build.
+static unsigned
+product_fans(int productid){
+  switch(productid){
+#if EMC_HAS_2301
+    case EMCPRODUCTID_2301:
+      return 1;
+#endif
+#if EMC_HAS_2302
+    case EMCPRODUCTID_2302:
+      return 2;
+#endif
+#if EMC_HAS_2303
+    case EMCPRODUCTID_2303:
+      return 3;
+#endif
+#if EMC_HAS_2305
+    case EMCPRODUCTID_2305:
+      return 5;
+#endif
+  }
+  return 0;
+}
+
+int emc230x_scan(i2c_master_bus_handle_t i2c, emc230x* emcs, unsigned maxemcs,
+                 unsigned* found){
+  *found = 0;
+  for(unsigned i = 0 ; i < sizeof(EMC230X_SEL_ADDRESSES) / sizeof(*EMC230X_SEL_ADDRESSES) ; ++i){
+    if(*found == maxemcs){
+      break;
+    }
+    const uint8_t addr = EMC230X_SEL_ADDRESSES[i];
+    // absent devices NACK immediately; the timeout only matters for a
+    // wedged bus, so don't spend the full SMBus timeout on each probe.
+    if(i2c_master_probe(i2c, addr, PROBE_TIMEOUT_MS) != ESP_OK){
+      continue;
+    }
+    emc230x* emc = &emcs[*found];
+    if(emc230x_add_device(i2c, addr, default_options.scl_speed_hz, &emc->i2c)){
+      // a failed scan leaves nothing for the caller to destroy
+      while(*found){
+        emc230x_destroy(&emcs[--*found]);
+      }
+      return -1;
+    }
+    emc->bus = i2c;
+    emc->scl_speed_hz = default_options.scl_speed_hz;
+    emc->timeout_ms = default_options.timeout_ms;
+    emc->xferwait = NULL;
+    emc230x_reset_stats(emc);
+    init_health(emc);
+    int productid = emc230x_read_ids(emc);
+    if(product_fans(productid)){
+      if(emc230x_init(emc, addr, productid) == 0){
+        ESP_LOGI(TAG, "found EMC230x (product 0x%02x) at 0x%02x", productid, addr);
+        ++*found;
+        continue;
+      }
+    }else{
+      ESP_LOGI(TAG, "device at 0x%02x is not a supported EMC230x", addr);
+    }
+    emc230x_rm_device(emc->i2c, addr);
+  }
+  return 0;
+}
+
+emc230x_model emc230x_getmodel(const emc230x* emc){
+  switch(emc->productid){
+    case EMCPRODUCTID_2301:
+      return EMC2301;
+    case EMCPRODUCTID_2302:
+      return emc->address == EMC2302_1_ADDRESS ? EMC2302_MODEL_1 : EMC2302_MODEL_2;
+    case EMCPRODUCTID_2303:
+      return EMC2303;
+  }
+  return EMC2305;
+}
+
 void emc230x_destroy(emc230x* emc){
   if(emc){
-    esp_err_t e = i2c_master_bus_rm_device(emc->i2c);
-    if(e != ESP_OK){
-      ESP_LOGW(TAG, "error (%s) removing i2c device at 0x%02x",
-               esp_err_to_name(e), emc->address);
-    }
+    emc230x_tachstats_detach(emc);
+    emc230x_rm_device(emc->i2c, emc->address);
+    xferwait_free(emc);
   }
 }
 
+unsigned emc230x_fancount(const emc230x* emc){
+#if EMC_MODELS == 1
+  // only the supported model can have been detected
+  (void)emc;
+  const unsigned fans = EMC_ONLY_FANS;
+#else
+  const unsigned fans = product_fans(emc->productid);
+#endif
+  return fans < EMC230X_MAXFANS ? fans : EMC230X_MAXFANS;
+}
+
 // verify that the specified fan is valid for the detected model.
 static inline bool
 check_fanidx(const emc230x* emc, unsigned fanidx){
-  unsigned maxfan;
-  switch(emc->productid){
-    case EMC2301:
-      maxfan = 0;
-      break;
-    case EMC2302_MODEL_1:
-    case EMC2302_MODEL_2:
-      maxfan = 1;
-      break;
-    case EMC2303:
-      maxfan = 2;
-      break;
-    case EMC2305:
-      maxfan = 4;
-      break;
-    default:
-      ESP_LOGE(TAG, "emc model invalid, uh-oh"); // this is very bad
-      return false;
+  unsigned fans = emc230x_fancount(emc);
+  if(fans == 0){
+    ESP_LOGE(TAG, "emc model invalid, uh-oh"); // this is very bad
+    return false;
   }
-  if(fanidx > maxfan){
-    ESP_LOGE(TAG, "invalid fan index %u (max %u)", fanidx, maxfan);
+  if(fanidx >= fans){
+    ESP_LOGE(TAG, "invalid fan index %u (max %u)", fanidx, fans - 1);
+    ((emc230x*)emc)->lasterr = EMC230X_ERR_INVALID;
     return false;
   }
   return true;
 }
 
-int emc230x_setpwm(const emc230x* emc, unsigned fanidx, uint8_t pwm){
-  if(!check_fanidx(emc, fanidx)){
+int emc230x_resync(emc230x* emc){
+  emc230x_shadow* sh = &emc->shadow;
+  if(emc230x_readreg(emc, EMCREG_CONFIGURATION, REGNAME("Configuration"), &sh->configuration)){
     return -1;
   }
-  uint8_t buf[] = {
-    EMCREG_FAN1SETTING + 16 * fanidx,
-    pwm
-  };
-  return emc230x_xmit(emc->i2c, buf, sizeof(buf));
-}
-
-int emc230x_gettach(const emc230x* emc, unsigned fanidx, unsigned* tach){
-  if(!check_fanidx(emc, fanidx)){
+  // FANINTR through PWMBASE123 are contiguous, and can be read in one go
+  uint8_t regs[EMCREG_PWMBASE123 - EMCREG_FANINTR + 1];
+  if(emc230x_readregs(emc, EMCREG_FANINTR, REGNAME("FanConfig"), regs, sizeof(regs))){
     return -1;
   }
-  int reg = EMCREG_TACH1READHIGH + 16 * fanidx;
-  uint8_t val;
-  if(emc230x_readreg(emc->i2c, reg, "ReadTachHigh", &val)){
-    return -1;
+  sh->fanintr = regs[EMCREG_FANINTR - EMCREG_FANINTR];
+  sh->pwmpolarity = regs[EMCREG_PWMPOLARITY - EMCREG_FANINTR];
+  sh->pwmoutput = regs[EMCREG_PWMOUTPUT - EMCREG_FANINTR];
+  sh->pwmbase45 = regs[EMCREG_PWMBASE45 - EMCREG_FANINTR];
+  sh->pwmbase123 = regs[EMCREG_PWMBASE123 - EMCREG_FANINTR];
+  unsigned fans = emc230x_fancount(emc);
+  for(unsigned i = 0 ; i < fans ; ++i){
+    uint8_t conf[2]; // CONF1 and CONF2 are adjacent
+    if(emc230x_readregs(emc, EMCREG_FAN1CONF1 + 16 * i, REGNAME("FanConf"), conf, sizeof(conf))){
+      return -1;
+    }
+    sh->fanconf1[i] = conf[0];
+    sh->fanconf2[i] = conf[1];
   }
-  *tach = val << 5u;
-  ++reg;
-  if(emc230x_readreg(emc->i2c, reg, "ReadTachLow", &val)){
+  return 0;
+}
+
+// write val to the software-locked register reg. on success, the shadow
+// byte *sh is updated to reflect the new value. within a configuration
+// batch, the shadow is updated as soon as the write is staged.
+static int
+emc230x_write_shadowed(emc230x* emc, emcreg_e reg, uint8_t* sh, uint8_t val){
+  if(emc230x_xmit_locked(emc, reg, val)){
     return -1;
   }
-  *tach += val >> 3u;
+  *sh = val;
   return 0;
 }
 
-int emc230x_gettach_rpm(const emc230x* emc, unsigned fanidx, unsigned* rpm){
-  unsigned tach;
-  if(emc230x_gettach(emc, fanidx, &tach)){
+int emc230x_config_begin(emc230x* emc){
+  if(emc->batching){
+    ESP_LOGE(TAG, "configuration batch already open");
     return -1;
   }
-  // assumes a two-pole, five-edge fan, a 32.768 kHz input clock, and that the
-  // tach multiplier is 1 (00 in the RANGE bits for the fan).
-  const unsigned edges = 5;
-  const float freq = 32768;
-  const float num = (edges - 1) * freq * 60;
-  const unsigned poles = 2;
-  const float tachmult = 1.0;
-  const float den = poles * tach / tachmult;
-  *rpm = num / den;
+  emc->batching = true;
+  emc->batchfailed = false;
+  emc->batchcount = 0;
+  emc->batchsaved = emc->shadow;
   return 0;
 }
 
-static int
-emc230x_set_configuration(const emc230x* emc, uint8_t mask, uint8_t bits, bool enabled){
-  uint8_t buf[] = {
-    EMCREG_CONFIGURATION,
-    0,
-  };
-  if(emc230x_readreg(emc->i2c, buf[0], "Configuration", buf + 1)){
+void emc230x_config_abort(emc230x* emc){
+  if(emc->batching){
+    emc->shadow = emc->batchsaved;
+    emc->batching = false;
+    emc->batchcount = 0;
+  }
+}
+
+int emc230x_config_commit(emc230x* emc){
+  if(!emc->batching){
+    ESP_LOGE(TAG, "no configuration batch open");
     return -1;
   }
-  buf[1] = (buf[1] & mask) | (enabled ? bits : 0);
-  if(emc230x_xmit_locked(emc->i2c, buf, sizeof(buf))){
+  if(emc->batchfailed){
+    ESP_LOGE(TAG, "configuration batch failed staging, discarding");
+    emc230x_config_abort(emc);
     return -1;
   }
-  return 0;
+  emc->batching = false;
+  if(emc->batchcount == 0){
+    return 0;
+  }
+  int ret = 0;
+  if(emc230x_set_softwarelock(emc, false)){
+    ret = -1;
+  }
+  for(unsigned i = 0 ; ret == 0 && i < emc->batchcount ; ++i){
+    if(emc230x_xmit(emc, emc->batch[i], sizeof(emc->batch[i]))){
+      ret = -1;
+    }
+  }
+  // always try to reengage the lock, even if some write failed
+  if(emc230x_set_softwarelock(emc, true)){
+    ret = -1;
+  }
+  emc->batchcount = 0;
+  if(ret){
+    // some prefix of the batch might have landed. our best guess at the
+    // device state is the one we had before the batch, but try to get
+    // the truth from the device.
+    emc->shadow = emc->batchsaved;
+    emc230x_resync(emc);
+  }
+  return ret;
 }
 
-int emc230x_set_clockoutput(const emc230x* emc){
-  return emc230x_set_configuration(emc, 0xfc, 2u, true);
+// writable registers of the 0x20..0x7f space. the status registers are
+// read-only (and reading them clears their latches), as are the tach
+// readings; 0xn4 is reserved in each fan's block.
+static bool
+snapshot_writable(uint8_t reg){
+  if(reg < EMCREG_FAN1SETTING){
+    return reg == EMCREG_CONFIGURATION ||
+           (reg >= EMCREG_FANINTR && reg <= EMCREG_PWMBASE123);
+  }
+  const unsigned off = reg & 0xf;
+  return off != 0x4 && off < EMCREG_TACH1READHIGH - EMCREG_FAN1SETTING;
 }
 
-int emc230x_set_clockinput(const emc230x* emc){
-  return emc230x_set_configuration(emc, 0xfc, 1u, true);
+// read the writable registers into regs (indexed from EMC230X_SNAPSHOT_BASE)
+// using three block reads, skipping the status registers. the fan blocks
+// are contiguous, and are read in one go.
+static int
+snapshot_read(const emc230x* emc, uint8_t* regs){
+  const unsigned fans = emc230x_fancount(emc);
+  if(emc230x_readreg(emc, EMCREG_CONFIGURATION, REGNAME("Configuration"),
+                     &regs[EMCREG_CONFIGURATION - EMC230X_SNAPSHOT_BASE]) ||
+      emc230x_readregs(emc, EMCREG_FANINTR, REGNAME("FanConfig"),
+                       &regs[EMCREG_FANINTR - EMC230X_SNAPSHOT_BASE],
+                       EMCREG_PWMBASE123 - EMCREG_FANINTR + 1) ||
+      emc230x_readregs(emc, EMCREG_FAN1SETTING, REGNAME("FanBlocks"),
+                       &regs[EMCREG_FAN1SETTING - EMC230X_SNAPSHOT_BASE], 16 * fans)){
+    return -1;
+  }
+  return 0;
 }
 
-int emc230x_set_clocklocal(const emc230x* emc){
-  return emc230x_set_configuration(emc, 0xfc, 0u, false);
+int emc230x_snapshot(const emc230x* emc, emc230x_regsnap* snap){
+  memset(snap, 0, sizeof(*snap));
+  snap->productid = emc->productid;
+  return snapshot_read(emc, snap->regs);
 }
 
-int emc230x_set_alertmask(const emc230x* emc, bool masked){
-  return emc230x_set_configuration(emc, 0x7f, 0x80, masked);
+int emc230x_restore(emc230x* emc, const emc230x_regsnap* snap, unsigned* rewritten){
+  if(snap->productid != emc->productid){
+    ESP_LOGE(TAG, "snapshot is of product 0x%02x, not 0x%02x", snap->productid, emc->productid);
+    return -1;
+  }
+  if(emc->batching){
+    ESP_LOGE(TAG, "can't restore with a configuration batch open");
+    return -1;
+  }
+  uint8_t cur[EMC230X_SNAPSHOT_BYTES];
+  if(snapshot_read(emc, cur)){
+    return -1;
+  }
+  const unsigned end = EMCREG_FAN1SETTING + 16 * emc230x_fancount(emc);
+  unsigned n = 0;
+  int ret = 0;
+  // FANxCONF1 goes last, so that FSC isn't enabled until its target and
+  // limits are back in place.
+  for(unsigned pass = 0 ; ret == 0 && pass < 2 ; ++pass){
+    for(unsigned reg = EMC230X_SNAPSHOT_BASE ; ret == 0 && reg < end ; ++reg){
+      const unsigned idx = reg - EMC230X_SNAPSHOT_BASE;
+      const bool conf1 = reg >= EMCREG_FAN1SETTING &&
+                         (reg & 0xf) == EMCREG_FAN1CONF1 - EMCREG_FAN1SETTING;
+      if(!snapshot_writable(reg) || conf1 != (pass == 1) || cur[idx] == snap->regs[idx]){
+        continue;
+      }
+      if(n++ == 0 && emc230x_set_softwarelock(emc, false)){
+        ret = -1;
+        break;
+      }
+      uint8_t buf[] = { reg, snap->regs[idx], };
+      if(emc230x_xmit(emc, buf, sizeof(buf))){
+        ret = -1;
+      }
+    }
+  }
+  if(n && emc230x_set_softwarelock(emc, true)){
+    ret = -1;
+  }
+  if(rewritten){
+    *rewritten = n;
+  }
+  if(ret){
+    emc230x_resync(emc);
+    return -1;
+  }
+  if(n){
+    ESP_LOGI(TAG, "restored %u registers", n);
+  }
+  // the device now matches the snapshot; bring the shadow along
+  emc230x_shadow* sh = &emc->shadow;
+  const uint8_t* r = snap->regs - EMC230X_SNAPSHOT_BASE;
+  sh->configuration = r[EMCREG_CONFIGURATION];
+  sh->fanintr = r[EMCREG_FANINTR];
+  sh->pwmpolarity = r[EMCREG_PWMPOLARITY];
+  sh->pwmoutput = r[EMCREG_PWMOUTPUT];
+  sh->pwmbase45 = r[EMCREG_PWMBASE45];
+  sh->pwmbase123 = r[EMCREG_PWMBASE123];
+  for(unsigned i = 0 ; i < emc230x_fancount(emc) ; ++i){
+    sh->fanconf1[i] = r[EMCREG_FAN1CONF1 + 16 * i];
+    sh->fanconf2[i] = r[EMCREG_FAN1CONF2 + 16 * i];
+  }
+  return 0;
 }
 
-int emc230x_set_timeout(const emc230x* emc, bool enabled){
-  return emc230x_set_configuration(emc, 0xbf, 0x40, enabled);
+int emc230x_setpwm(const emc230x* emc, unsigned fanidx, uint8_t pwm){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  uint8_t buf[] = {
+    EMCREG_FAN1SETTING + 16 * fanidx,
+    pwm
+  };
+  return emc230x_xmit(emc, buf, sizeof(buf));
 }
 
-int emc230x_set_watchdog(const emc230x* emc, bool enabled){
-  return emc230x_set_configuration(emc, 0xdf, 0x20, enabled);
+int emc230x_getpwm(const emc230x* emc, unsigned fanidx, uint8_t* pwm){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  return emc230x_readreg(emc, EMCREG_FAN1SETTING + 16 * fanidx, REGNAME("FanSetting"), pwm);
 }
 
-static int
-emc230x_set_fan_bit(const emc230x* emc, unsigned fanidx, bool enabled,
-                    emcreg_e reg, const char* name){
-  uint8_t buf[] = { reg, 0, };
+// the period (in microseconds) of the UPDATE field of FANxCONF1, over which
+// the device refreshes its tach reading
+static const int64_t update_us[] = {
+  100000, 200000, 300000, 400000, 500000, 800000, 1200000, 1600000,
+};
+
+// the cache is updated through const handles, as are the statistics. a
+// hit requires the reading to be younger than its fan's update period,
+// and FANxCONF1 to be unchanged since (a new scale or period might apply).
+static bool
+tach_cached(const emc230x* emc, unsigned fanidx, int64_t now, unsigned* tach){
+  const emc230x_readcache* c = &emc->cache;
+  const uint8_t conf1 = emc->shadow.fanconf1[fanidx];
+  if(!(c->tachvalid & (1u << fanidx)) || c->tachconf1[fanidx] != conf1 ||
+      now - c->tach_us[fanidx] >= update_us[conf1 & EMC_CONF1_UPDATE]){
+    return false;
+  }
+  *tach = c->tach[fanidx];
+  return true;
+}
+
+static void
+tach_cache(const emc230x* emc, unsigned fanidx, int64_t when, unsigned tach){
+  emc230x_readcache* c = &((emc230x*)emc)->cache;
+  c->tach[fanidx] = tach;
+  c->tach_us[fanidx] = when;
+  c->tachconf1[fanidx] = emc->shadow.fanconf1[fanidx];
+  c->tachvalid |= 1u << fanidx;
+}
+
+int emc230x_gettach_opt(const emc230x* emc, unsigned fanidx, bool fresh, unsigned* tach){
   if(!check_fanidx(emc, fanidx)){
     return -1;
   }
-  if(emc230x_readreg(emc->i2c, buf[0], name, buf + 1)){
+  const int64_t now = esp_timer_get_time();
+  if(!fresh && tach_cached(emc, fanidx, now, tach)){
+    return 0;
+  }
+  // read the high and low bytes together, so that we can't get a torn value
+  uint8_t val[2];
+  if(emc230x_readregs(emc, EMCREG_TACH1READHIGH + 16 * fanidx, REGNAME("ReadTach"), val, sizeof(val))){
     return -1;
   }
-  buf[1] &= ~(1u << fanidx);
-  if(enabled){
-    buf[1] |= 1u << fanidx;
+  *tach = tach_from_regs(val[0], val[1]);
+  tach_cache(emc, fanidx, now, *tach);
+  emc230x_tachstats_feed(emc, fanidx, *tach);
+  return 0;
+}
+
+int emc230x_gettach(const emc230x* emc, unsigned fanidx, unsigned* tach){
+  return emc230x_gettach_opt(emc, fanidx, false, tach);
+}
+
+// tach counts are expressed in cycles of this clock
+#define EMC_TACH_CLOCK_HZ 32768u
+
+// the tach multiplier m corresponding to FANxCONF1's RANGE bits is 1 << RANGE,
+// and the number of edges n corresponding to its EDGES bits is 3 + 2 * EDGES.
+// for a fan with p poles, the datasheet gives:
+//
+//   rpm = (n - 1) * m * 60 * 32768 / (p * count)
+//
+// the numerator is at most 8 * 8 * 60 * 32768 = 125829120, fitting easily
+// in 32 bits, so no floating point is necessary.
+static uint32_t
+tach_numerator(const emc230x* emc, unsigned fanidx){
+  const uint8_t conf1 = emc->shadow.fanconf1[fanidx];
+  const uint32_t edges = 3 + 2 * ((conf1 & EMC_CONF1_EDGES) >> EMC_CONF1_EDGES_SHIFT);
+  const uint32_t mult = 1u << ((conf1 & EMC_CONF1_RANGE) >> EMC_CONF1_RANGE_SHIFT);
+  return (edges - 1) * mult * 60u * EMC_TACH_CLOCK_HZ;
+}
+
+// convert a tach count to rpm, rounding to nearest. a count of zero or
+// EMC_TACH_MAX (a stalled or stopped fan) is zero rpm.
+static unsigned
+tach_to_rpm(const emc230x* emc, unsigned fanidx, unsigned tach){
+  if(tach == 0 || tach >= EMC_TACH_MAX){
+    return 0;
+  }
+  const uint32_t den = emc->poles[fanidx] * tach;
+  return (tach_numerator(emc, fanidx) + den / 2) / den;
+}
+
+// convert rpm to a tach count, rounding to nearest. zero rpm, or a speed too
+// low to be represented, is EMC_TACH_MAX.
+static unsigned
+rpm_to_tach(const emc230x* emc, unsigned fanidx, unsigned rpm){
+  if(rpm == 0){
+    return EMC_TACH_MAX;
   }
-  if(emc230x_xmit_locked(emc->i2c, buf, sizeof(buf))){
+  // poles * rpm can exceed 32 bits (and wrap to zero) for absurd rpm
+  const uint64_t den = (uint64_t)emc->poles[fanidx] * rpm;
+  const uint64_t tach = (tach_numerator(emc, fanidx) + den / 2) / den;
+  return tach > EMC_TACH_MAX ? EMC_TACH_MAX : tach;
+}
+
+int emc230x_tach_to_rpm(const emc230x* emc, unsigned fanidx, unsigned tach, unsigned* rpm){
+  if(!check_fanidx(emc, fanidx)){
     return -1;
   }
+  *rpm = tach_to_rpm(emc, fanidx, tach);
   return 0;
 }
 
-int emc230x_set_interrupt(const emc230x* emc, unsigned fanidx, bool enabled){
-  return emc230x_set_fan_bit(emc, fanidx, enabled, EMCREG_FANINTR, "InterruptEnabled");
+int emc230x_rpm_to_tach(const emc230x* emc, unsigned fanidx, unsigned rpm, unsigned* tach){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  *tach = rpm_to_tach(emc, fanidx, rpm);
+  return 0;
 }
 
-int emc230x_set_pwmpolarity(const emc230x* emc, unsigned fanidx, bool inverted){
-  return emc230x_set_fan_bit(emc, fanidx, inverted, EMCREG_PWMPOLARITY, "PWMPolarity");
+int emc230x_gettach_rpm(const emc230x* emc, unsigned fanidx, unsigned* rpm){
+  unsigned tach;
+  if(emc230x_gettach(emc, fanidx, &tach)){
+    return -1;
+  }
+  *rpm = tach_to_rpm(emc, fanidx, tach);
+  return 0;
 }
 
-int emc230x_set_pwmoutput(const emc230x* emc, unsigned fanidx, bool pushpull){
-  return emc230x_set_fan_bit(emc, fanidx, pushpull, EMCREG_PWMOUTPUT, "PWMOutput");
+#ifdef EMC230X_DEFINED_OPS
+static int
+gettach_all_bus(const emc230x* emc, unsigned tach[EMC230X_MAXFANS]){
+  const unsigned fans = emc230x_fancount(emc);
+  uint8_t addrw = emc->address << 1u;
+  uint8_t addrr = (emc->address << 1u) | 1u;
+  uint8_t wbufs[EMC230X_MAXFANS][2];
+  uint8_t vals[EMC230X_MAXFANS][2];
+  // each fan is a write of the register followed by a 2-byte read, all
+  // chained with repeated STARTs, and a single STOP at the end.
+  i2c_operation_job_t ops[EMC230X_MAXFANS * 6 + 1];
+  unsigned o = 0;
+  for(unsigned i = 0 ; i < fans ; ++i){
+    wbufs[i][0] = addrw;
+    wbufs[i][1] = EMCREG_TACH1READHIGH + 16 * i;
+    ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_START, };
+    ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_WRITE,
+      .write = { .ack_check = true, .data = wbufs[i], .total_bytes = 2, }, };
+    ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_START, };
+    ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_WRITE,
+      .write = { .ack_check = true, .data = &addrr, .total_bytes = 1, }, };
+    ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_READ,
+      .read = { .ack_value = I2C_ACK_VAL, .data = &vals[i][0], .total_bytes = 1, }, };
+    ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_READ,
+      .read = { .ack_value = I2C_NACK_VAL, .data = &vals[i][1], .total_bytes = 1, }, };
+  }
+  ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_STOP, };
+  const emcxfer x = { .ops = ops, .opcount = o, };
+  esp_err_t e = emc230x_transfer(emc, EMC230X_OP_CHAINED, fans * 3, &x);
+  if(e != ESP_OK){
+    if(!fastfailed(emc)){
+      ESP_LOGE(TAG, "error (%s) reading %u tachs via I2C", esp_err_to_name(e), fans);
+    }
+    return -1;
+  }
+  for(unsigned i = 0 ; i < fans ; ++i){
+    tach[i] = tach_from_regs(vals[i][0], vals[i][1]);
+    emc230x_tachstats_feed(emc, i, tach[i]);
+  }
+  return 0;
 }
 
-int emc230x_set_pwmbasefreq(const emc230x* emc, unsigned fanidx, emc230x_base_freq freq){
+int emc230x_setpwm_all(const emc230x* emc, const uint8_t pwm[EMC230X_MAXFANS],
+                       unsigned mask){
+  const unsigned fans = emc230x_fancount(emc);
+  if(mask >> fans){
+    ESP_LOGE(TAG, "invalid fan mask 0x%02x (%u fans)", mask, fans);
+    return -1;
+  }
+  uint8_t wbufs[EMC230X_MAXFANS][3];
+  i2c_operation_job_t ops[EMC230X_MAXFANS * 2 + 1];
+  unsigned o = 0;
+  for(unsigned i = 0 ; i < fans ; ++i){
+    if(mask & (1u << i)){
+      wbufs[i][0] = emc->address << 1u;
+      wbufs[i][1] = EMCREG_FAN1SETTING + 16 * i;
+      wbufs[i][2] = pwm[i];
+      ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_START, };
+      ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_WRITE,
+        .write = { .ack_check = true, .data = wbufs[i], .total_bytes = 3, }, };
+    }
+  }
+  if(o == 0){
+    return 0;
+  }
+  ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_STOP, };
+  const emcxfer x = { .ops = ops, .opcount = o, };
+  esp_err_t e = emc230x_transfer(emc, EMC230X_OP_CHAINED, (o - 1) / 2 * 2, &x);
+  if(e != ESP_OK){
+    if(!fastfailed(emc)){
+      ESP_LOGE(TAG, "error (%s) writing PWM mask 0x%02x via I2C", esp_err_to_name(e), mask);
+    }
+    return -1;
+  }
+  return 0;
+}
+#else
+// without custom transaction sequences, fall back to one transaction per fan,
+// still avoiding per-fan revalidation.
+static int
+gettach_all_bus(const emc230x* emc, unsigned tach[EMC230X_MAXFANS]){
+  const unsigned fans = emc230x_fancount(emc);
+  for(unsigned i = 0 ; i < fans ; ++i){
+    uint8_t val[2];
+    if(emc230x_readregs(emc, EMCREG_TACH1READHIGH + 16 * i, REGNAME("ReadTach"), val, sizeof(val))){
+      return -1;
+    }
+    tach[i] = tach_from_regs(val[0], val[1]);
+    emc230x_tachstats_feed(emc, i, tach[i]);
+  }
+  return 0;
+}
+
+int emc230x_setpwm_all(const emc230x* emc, const uint8_t pwm[EMC230X_MAXFANS],
+                       unsigned mask){
+  const unsigned fans = emc230x_fancount(emc);
+  if(mask >> fans){
+    ESP_LOGE(TAG, "invalid fan mask 0x%02x (%u fans)", mask, fans);
+    return -1;
+  }
+  for(unsigned i = 0 ; i < fans ; ++i){
+    if(mask & (1u << i)){
+      uint8_t buf[] = {
+        EMCREG_FAN1SETTING + 16 * i,
+        pwm[i]
+      };
+      if(emc230x_xmit(emc, buf, sizeof(buf))){
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+#endif
+
+// the bus read is all or nothing, so any miss refreshes every fan
+int emc230x_gettach_all_opt(const emc230x* emc, bool fresh, unsigned tach[EMC230X_MAXFANS]){
+  const unsigned fans = emc230x_fancount(emc);
+  const int64_t now = esp_timer_get_time();
+  if(!fresh){
+    unsigned i = 0;
+    while(i < fans && tach_cached(emc, i, now, &tach[i])){
+      ++i;
+    }
+    if(i == fans){
+      return 0;
+    }
+  }
+  if(gettach_all_bus(emc, tach)){
+    return -1;
+  }
+  for(unsigned i = 0 ; i < fans ; ++i){
+    tach_cache(emc, i, now, tach[i]);
+  }
+  return 0;
+}
+
+int emc230x_gettach_all(const emc230x* emc, unsigned tach[EMC230X_MAXFANS]){
+  return emc230x_gettach_all_opt(emc, false, tach);
+}
+
+static int
+emc230x_set_configuration(emc230x* emc, uint8_t mask, uint8_t bits, bool enabled){
+  uint8_t v = (emc->shadow.configuration & mask) | (enabled ? bits : 0);
+  return emc230x_write_shadowed(emc, EMCREG_CONFIGURATION, &emc->shadow.configuration, v);
+}
+
+int emc230x_set_clockoutput(emc230x* emc){
+  return emc230x_set_configuration(emc, 0xfc, 2u, true);
+}
+
+int emc230x_set_clockinput(emc230x* emc){
+  return emc230x_set_configuration(emc, 0xfc, 1u, true);
+}
+
+int emc230x_set_clocklocal(emc230x* emc){
+  return emc230x_set_configuration(emc, 0xfc, 0u, false);
+}
+
+int emc230x_set_alertmask(emc230x* emc, bool masked){
+  return emc230x_set_configuration(emc, 0x7f, 0x80, masked);
+}
+
+int emc230x_set_timeout(emc230x* emc, bool enabled){
+  if(enabled && emc->scl_speed_hz > SMBUS_MAX_HZ){
+    ESP_LOGE(TAG, "SMBus timeout can't be used at %" PRIu32 " Hz", emc->scl_speed_hz);
+    return -1;
+  }
+  // the DIS_TO bit disables the timeout when set
+  return emc230x_set_configuration(emc, 0xbf, EMC_CONFIG_DIS_TO, !enabled);
+}
+
+int emc230x_set_watchdog(emc230x* emc, bool enabled){
+  return emc230x_set_configuration(emc, 0xdf, 0x20, enabled);
+}
+
+static int
+emc230x_set_fan_bit(emc230x* emc, unsigned fanidx, bool enabled,
+                    emcreg_e reg, uint8_t* sh){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  uint8_t v = *sh & ~(1u << fanidx);
+  if(enabled){
+    v |= 1u << fanidx;
+  }
+  return emc230x_write_shadowed(emc, reg, sh, v);
+}
+
+int emc230x_set_interrupt(emc230x* emc, unsigned fanidx, bool enabled){
+  return emc230x_set_fan_bit(emc, fanidx, enabled, EMCREG_FANINTR, &emc->shadow.fanintr);
+}
+
+int emc230x_set_pwmpolarity(emc230x* emc, unsigned fanidx, bool inverted){
+  return emc230x_set_fan_bit(emc, fanidx, inverted, EMCREG_PWMPOLARITY, &emc->shadow.pwmpolarity);
+}
+
+int emc230x_set_pwmoutput(emc230x* emc, unsigned fanidx, bool pushpull){
+  return emc230x_set_fan_bit(emc, fanidx, pushpull, EMCREG_PWMOUTPUT, &emc->shadow.pwmoutput);
+}
+
+int emc230x_set_pwmbasefreq(emc230x* emc, unsigned fanidx, emc230x_base_freq freq){
   if(!check_fanidx(emc, fanidx)){
     return -1;
   }
@@ -490,45 +1471,456 @@ int emc230x_set_pwmbasefreq(const emc230x* emc, unsigned fanidx, emc230x_base_fr
     ESP_LOGE(TAG, "frequency specifier (%d) too high for fan %u", freq, fanidx);
     return -1;
   }
-  const char* name;
+  uint8_t* sh;
   uint8_t reg;
   uint8_t mask;
   uint8_t bits;
+  // fans 1 through 3 use the low six bits of PWMBASE123, while fans 4 and 5
+  // use the low four bits of PWMBASE45.
   if(fanidx <= 2){
     reg = EMCREG_PWMBASE123;
     mask = 0x3u << (2 * fanidx);
-    name = "PWMBaseFreq123";
+    sh = &emc->shadow.pwmbase123;
     bits = freq << (2 * fanidx);
   }else{
     reg = EMCREG_PWMBASE45;
-    mask = 0x3u << (2 * (fanidx - 2));
-    name = "PWMBaseFreq45";
-    bits = freq << (2 * (fanidx - 2));
+    mask = 0x3u << (2 * (fanidx - 3));
+    sh = &emc->shadow.pwmbase45;
+    bits = freq << (2 * (fanidx - 3));
+  }
+  return emc230x_write_shadowed(emc, reg, sh, (*sh & ~mask) | bits);
+}
+
+int emc230x_read_fanstatus(const emc230x* emc, uint8_t* fsr){
+  return emc230x_readreg(emc, EMCREG_FANSTATUS, REGNAME("FanStatus"), fsr);
+}
+
+int emc230x_read_fanstallstatus(const emc230x* emc, uint8_t* fss){
+  return emc230x_readreg(emc, EMCREG_STALLSTATUS, REGNAME("FanStallStatus"), fss);
+}
+
+int emc230x_read_fanspinstatus(const emc230x* emc, uint8_t* fss){
+  return emc230x_readreg(emc, EMCREG_SPINSTATUS, REGNAME("FanSpinStatus"), fss);
+}
+
+int emc230x_read_fandrivefail(const emc230x* emc, uint8_t* fdf){
+  return emc230x_readreg(emc, EMCREG_DRIVESTATUS, REGNAME("FanDriveFail"), fdf);
+}
+
+int emc230x_read_all_status_opt(const emc230x* emc, bool fresh, emc230x_status* status){
+  emc230x_readcache* c = &((emc230x*)emc)->cache;
+  const int64_t now = esp_timer_get_time();
+  if(!fresh && c->statusvalid){
+    // status is evaluated with the tach measurements, so the shortest
+    // update period of any fan bounds its lifetime
+    int64_t period = update_us[EMC230X_UPDATE_1600MS];
+    for(unsigned i = 0 ; i < emc230x_fancount(emc) ; ++i){
+      const int64_t p = update_us[emc->shadow.fanconf1[i] & EMC_CONF1_UPDATE];
+      if(p < period){
+        period = p;
+      }
+    }
+    if(now - c->status_us < period){
+      *status = c->status;
+      return 0;
+    }
+  }
+  uint8_t regs[EMCREG_DRIVESTATUS - EMCREG_FANSTATUS + 1];
+  if(emc230x_readregs(emc, EMCREG_FANSTATUS, REGNAME("FanStatusAll"), regs, sizeof(regs))){
+    return -1;
+  }
+  status->fanstatus = regs[EMCREG_FANSTATUS - EMCREG_FANSTATUS];
+  status->stall = regs[EMCREG_STALLSTATUS - EMCREG_FANSTATUS];
+  status->spin = regs[EMCREG_SPINSTATUS - EMCREG_FANSTATUS];
+  status->drivefail = regs[EMCREG_DRIVESTATUS - EMCREG_FANSTATUS];
+  c->status = *status;
+  c->status_us = now;
+  c->statusvalid = true;
+  return 0;
+}
+
+// the registers are clear-on-read, so a cached copy would hide new events
+// from (e.g.) an ALERT handler; only callers asking for the cache get it.
+int emc230x_read_all_status(const emc230x* emc, emc230x_status* status){
+  return emc230x_read_all_status_opt(emc, true, status);
+}
+
+int emc230x_enable_fsc(emc230x* emc, unsigned fanidx, bool enabled){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  uint8_t* sh = &emc->shadow.fanconf1[fanidx];
+  uint8_t v = *sh & ~EMC_CONF1_EN_ALGO;
+  if(enabled){
+    v |= EMC_CONF1_EN_ALGO;
+  }
+  return emc230x_write_shadowed(emc, EMCREG_FAN1CONF1 + 16 * fanidx, sh, v);
+}
+
+int emc230x_set_target_tach(emc230x* emc, unsigned fanidx, unsigned tach){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  if(tach > EMC_TACH_MAX){
+    ESP_LOGE(TAG, "tach target 0x%x too high for fan %u", tach, fanidx);
+    return -1;
+  }
+  // TARGLOW and TARGHIGH are adjacent, and the target is latched upon the
+  // write to TARGHIGH, so write them low-to-high in one transaction.
+  uint8_t buf[] = {
+    EMCREG_TACH1TARGLOW + 16 * fanidx,
+    (tach & 0x1fu) << 3u,
+    tach >> 5u,
+  };
+  return emc230x_xmit(emc, buf, sizeof(buf));
+}
+
+int emc230x_set_target_rpm(emc230x* emc, unsigned fanidx, unsigned rpm){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  return emc230x_set_target_tach(emc, fanidx, rpm_to_tach(emc, fanidx, rpm));
+}
+
+int emc230x_set_fsc_options(emc230x* emc, unsigned fanidx,
+                            const emc230x_fsc_options* opts){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
   }
-  uint8_t buf[] = { reg, 0, };
-  if(emc230x_readreg(emc->i2c, buf[0], name, buf + 1)){
+  if(opts->update > EMC230X_UPDATE_1600MS || opts->gainp > EMC230X_GAIN_8X ||
+      opts->gaini > EMC230X_GAIN_8X || opts->gaind > EMC230X_GAIN_8X ||
+      opts->derivative > EMC230X_DERIVATIVE_BOTH ||
+      opts->errrange > EMC230X_ERRRANGE_200RPM){
+    ESP_LOGE(TAG, "invalid FSC options for fan %u", fanidx);
     return -1;
   }
-  buf[1] &= ~mask;
-  buf[1] |= bits;
-  if(emc230x_xmit_locked(emc->i2c, buf, sizeof(buf))){
+  // use the caller's batch if one is open, otherwise our own
+  const bool ownbatch = !emc->batching;
+  if(ownbatch && emc230x_config_begin(emc)){
     return -1;
   }
+  uint8_t* sh1 = &emc->shadow.fanconf1[fanidx];
+  uint8_t* sh2 = &emc->shadow.fanconf2[fanidx];
+  uint8_t gain = (opts->gaind << 4u) | (opts->gaini << 2u) | opts->gainp;
+  uint8_t conf1 = (*sh1 & ~EMC_CONF1_UPDATE) | opts->update;
+  uint8_t conf2 = (*sh2 & ~(EMC_CONF2_DER_OPT | EMC_CONF2_ERR_RNG)) |
+                  (opts->derivative << EMC_CONF2_DER_OPT_SHIFT) |
+                  (opts->errrange << EMC_CONF2_ERR_RNG_SHIFT);
+  if(emc230x_write_shadowed(emc, EMCREG_FAN1CONF1 + 16 * fanidx, sh1, conf1) ||
+      emc230x_write_shadowed(emc, EMCREG_FAN1CONF2 + 16 * fanidx, sh2, conf2) ||
+      emc230x_xmit_locked(emc, EMCREG_GAIN1 + 16 * fanidx, gain)){
+    if(ownbatch){
+      emc230x_config_abort(emc);
+    }
+    return -1;
+  }
+  if(ownbatch){
+    return emc230x_config_commit(emc);
+  }
   return 0;
 }
 
-int emc230x_read_fanstatus(const emc230x* emc, uint8_t* fsr){
-  return emc230x_readreg(emc->i2c, EMCREG_FANSTATUS, "FanStatus", fsr);
+int emc230x_set_ramp(emc230x* emc, unsigned fanidx,
+                     const emc230x_ramp_options* opts){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  if(opts->maxstep == 0 || opts->maxstep > EMC_MAXSTEP_MAX ||
+      opts->update > EMC230X_UPDATE_1600MS){
+    ESP_LOGE(TAG, "invalid ramp options for fan %u", fanidx);
+    return -1;
+  }
+  const bool ownbatch = !emc->batching;
+  if(ownbatch && emc230x_config_begin(emc)){
+    return -1;
+  }
+  uint8_t* sh1 = &emc->shadow.fanconf1[fanidx];
+  uint8_t* sh2 = &emc->shadow.fanconf2[fanidx];
+  uint8_t conf1 = (*sh1 & ~EMC_CONF1_UPDATE) | opts->update;
+  uint8_t conf2 = opts->enabled ? *sh2 | EMC_CONF2_EN_RRC : *sh2 & ~EMC_CONF2_EN_RRC;
+  if(emc230x_write_shadowed(emc, EMCREG_FAN1CONF1 + 16 * fanidx, sh1, conf1) ||
+      emc230x_write_shadowed(emc, EMCREG_FAN1CONF2 + 16 * fanidx, sh2, conf2) ||
+      emc230x_xmit_locked(emc, EMCREG_FAN1MAXSTEP + 16 * fanidx, opts->maxstep)){
+    if(ownbatch){
+      emc230x_config_abort(emc);
+    }
+    return -1;
+  }
+  if(ownbatch){
+    return emc230x_config_commit(emc);
+  }
+  return 0;
 }
 
-int emc230x_read_fanstallstatus(const emc230x* emc, uint8_t* fss){
-  return emc230x_readreg(emc->i2c, EMCREG_STALLSTATUS, "FanStallStatus", fss);
+int emc230x_set_spinup(emc230x* emc, unsigned fanidx,
+                       const emc230x_spinup_options* opts){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  if(opts->level > EMC230X_SPINLEVEL_65PCT || opts->time > EMC230X_SPINTIME_2S ||
+      opts->drivefailcnt > EMC230X_DRIVEFAIL_64){
+    ESP_LOGE(TAG, "invalid spin-up options for fan %u", fanidx);
+    return -1;
+  }
+  uint8_t v = (opts->drivefailcnt << EMC_SPINUP_DRIVE_FAIL_CNT_SHIFT) |
+              (opts->nokick ? EMC_SPINUP_NOKICK : 0) |
+              (opts->level << EMC_SPINUP_SPIN_LVL_SHIFT) |
+              opts->time;
+  return emc230x_xmit_locked(emc, EMCREG_FAN1SPINUP + 16 * fanidx, v);
 }
 
-int emc230x_read_fanspinstatus(const emc230x* emc, uint8_t* fss){
-  return emc230x_readreg(emc->i2c, EMCREG_SPINSTATUS, "FanSpinStatus", fss);
+int emc230x_set_mindrive(emc230x* emc, unsigned fanidx, uint8_t pwm){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  return emc230x_xmit_locked(emc, EMCREG_FAN1MINDRIVE + 16 * fanidx, pwm);
 }
 
-int emc230x_read_fandrivefail(const emc230x* emc, uint8_t* fdf){
-  return emc230x_readreg(emc->i2c, EMCREG_DRIVESTATUS, "FanDriveFail", fdf);
+int emc230x_set_min_rpm(emc230x* emc, unsigned fanidx, unsigned rpm){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  // VALIDTACH holds the high byte of the largest valid 13-bit count
+  const unsigned tach = rpm_to_tach(emc, fanidx, rpm);
+  return emc230x_xmit_locked(emc, EMCREG_FAN1VALIDTACH + 16 * fanidx, tach >> 5u);
+}
+
+int emc230x_set_drivefail_band(emc230x* emc, unsigned fanidx, unsigned tach){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  if(tach > EMC_TACH_MAX){
+    ESP_LOGE(TAG, "drive fail band 0x%x too wide for fan %u", tach, fanidx);
+    return -1;
+  }
+  // written low-to-high, as with the tach target. outside of a batch,
+  // this is two unlock/lock brackets; open a batch to combine them.
+  if(emc230x_xmit_locked(emc, EMCREG_FAN1FAILLOW + 16 * fanidx, (tach & 0x1fu) << 3u) ||
+      emc230x_xmit_locked(emc, EMCREG_FAN1FAILHIGH + 16 * fanidx, tach >> 5u)){
+    return -1;
+  }
+  return 0;
+}
+
+int emc230x_set_fan_poles(emc230x* emc, unsigned fanidx, unsigned poles){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  if(poles == 0 || poles > UINT8_MAX){
+    ESP_LOGE(TAG, "invalid pole count %u for fan %u", poles, fanidx);
+    return -1;
+  }
+  emc->poles[fanidx] = poles;
+  return 0;
+}
+
+int emc230x_set_tach_config(emc230x* emc, unsigned fanidx, unsigned edges,
+                            emc230x_range range){
+  if(!check_fanidx(emc, fanidx)){
+    return -1;
+  }
+  if(edges < 3 || edges > 9 || edges % 2 == 0){
+    ESP_LOGE(TAG, "invalid edge count %u for fan %u", edges, fanidx);
+    return -1;
+  }
+  if(range > EMC230X_RANGE_4000RPM){
+    ESP_LOGE(TAG, "invalid range %d for fan %u", range, fanidx);
+    return -1;
+  }
+  uint8_t* sh = &emc->shadow.fanconf1[fanidx];
+  uint8_t v = (*sh & ~(EMC_CONF1_EDGES | EMC_CONF1_RANGE)) |
+              (((edges - 3) / 2) << EMC_CONF1_EDGES_SHIFT) |
+              (range << EMC_CONF1_RANGE_SHIFT);
+  return emc230x_write_shadowed(emc, EMCREG_FAN1CONF1 + 16 * fanidx, sh, v);
+}
+
+int emc230x_set_autorange(emc230x* emc, unsigned mask){
+  const unsigned fans = emc230x_fancount(emc);
+  if(mask >> fans){
+    ESP_LOGE(TAG, "invalid fan mask 0x%02x (%u fans)", mask, fans);
+    return -1;
+  }
+  emc->autorange = mask;
+  return 0;
+}
+
+// auto-ranging moves along this ladder of EDGES and RANGE codes, each step
+// doubling the count for a given speed: (edges - 1) * multiplier is 2, 4,
+// 8 (the default), 16, 32, and 64.
+static const struct {
+  uint8_t edges;
+  uint8_t range;
+} autorange_steps[] = {
+  { 0, 0, }, { 1, 0, }, { 1, 1, }, { 1, 2, }, { 1, 3, }, { 3, 3, },
+};
+
+#define AUTORANGE_STEPS (sizeof(autorange_steps) / sizeof(*autorange_steps))
+
+// counts are kept between these, far enough apart that a step in either
+// direction lands within the window.
+#define AUTORANGE_LOW  0x0c00u
+#define AUTORANGE_HIGH 0x1c00u
+
+// (edges - 1) * multiplier for a FANxCONF1 value
+static unsigned
+conf1_scale(uint8_t conf1){
+  const unsigned edges = 3 + 2 * ((conf1 & EMC_CONF1_EDGES) >> EMC_CONF1_EDGES_SHIFT);
+  return (edges - 1) << ((conf1 & EMC_CONF1_RANGE) >> EMC_CONF1_RANGE_SHIFT);
+}
+
+static unsigned
+step_scale(unsigned step){
+  return (2 + 2 * autorange_steps[step].edges) << autorange_steps[step].range;
+}
+
+// the highest step not exceeding the configured scale, so that a fan
+// configured off the ladder joins it
+static unsigned
+autorange_step(uint8_t conf1){
+  const unsigned scale = conf1_scale(conf1);
+  unsigned step = 0;
+  while(step + 1 < AUTORANGE_STEPS && step_scale(step + 1) <= scale){
+    ++step;
+  }
+  return step;
+}
+
+// rescale count from oldscale to newscale, saturating at max
+static unsigned
+rescale_count(unsigned count, unsigned oldscale, unsigned newscale, unsigned max){
+  const uint32_t c = (uint32_t)count * newscale / oldscale;
+  return c > max ? max : c;
+}
+
+// move fanidx to step. the valid tach limit, the drive fail band, and the
+// tach target are all expressed in counts at the old scale, and must be
+// rescaled along with it. these are read in one go (they're contiguous),
+// and everything is written within a single unlock/lock bracket.
+static int
+autorange_fan(emc230x* emc, unsigned fanidx, unsigned step){
+  uint8_t* sh = &emc->shadow.fanconf1[fanidx];
+  const unsigned oldscale = conf1_scale(*sh);
+  uint8_t v = (*sh & ~(EMC_CONF1_EDGES | EMC_CONF1_RANGE)) |
+              (autorange_steps[step].edges << EMC_CONF1_EDGES_SHIFT) |
+              (autorange_steps[step].range << EMC_CONF1_RANGE_SHIFT);
+  const unsigned newscale = conf1_scale(v);
+  const uint8_t base = EMCREG_FAN1VALIDTACH + 16 * fanidx;
+  // VALIDTACH, FAILLOW, FAILHIGH, TARGLOW, TARGHIGH
+  uint8_t r[EMCREG_TACH1TARGHIGH - EMCREG_FAN1VALIDTACH + 1];
+  if(emc230x_readregs(emc, base, REGNAME("TachLimits"), r, sizeof(r))){
+    return -1;
+  }
+  // VALIDTACH holds only the high byte of its count
+  const unsigned valid = rescale_count(r[0], oldscale, newscale, UINT8_MAX);
+  const unsigned fail = rescale_count(tach_from_regs(r[2], r[1]), oldscale,
+                                      newscale, EMC_TACH_MAX);
+  unsigned targ = tach_from_regs(r[4], r[3]);
+  // a target of EMC_TACH_MAX stops the fan, and is left alone
+  if(targ < EMC_TACH_MAX){
+    targ = rescale_count(targ, oldscale, newscale, EMC_TACH_MAX);
+  }
+  if(emc230x_config_begin(emc)){
+    return -1;
+  }
+  // the limits and target are written low-to-high, following CONF1
+  if(emc230x_write_shadowed(emc, EMCREG_FAN1CONF1 + 16 * fanidx, sh, v) ||
+      emc230x_xmit_locked(emc, base, valid) ||
+      emc230x_xmit_locked(emc, base + 1, (fail & 0x1fu) << 3u) ||
+      emc230x_xmit_locked(emc, base + 2, fail >> 5u) ||
+      emc230x_xmit_locked(emc, base + 3, (targ & 0x1fu) << 3u) ||
+      emc230x_xmit_locked(emc, base + 4, targ >> 5u)){
+    emc230x_config_abort(emc);
+    return -1;
+  }
+  if(emc230x_config_commit(emc)){
+    return -1;
+  }
+  ESP_LOGD(TAG, "fan %u autoranged to scale %u", fanidx, newscale);
+  return 0;
+}
+
+int emc230x_autorange(emc230x* emc, const unsigned tach[EMC230X_MAXFANS],
+                      unsigned* changed){
+  unsigned ch = 0;
+  int ret = 0;
+  // an open batch would defer the write, while rpm conversions of new
+  // readings assumed it had landed
+  if(!emc->batching){
+    const unsigned fans = emc230x_fancount(emc);
+    for(unsigned i = 0 ; i < fans ; ++i){
+      if(!(emc->autorange & (1u << i)) || tach[i] == 0){
+        continue;
+      }
+      const unsigned step = autorange_step(emc->shadow.fanconf1[i]);
+      unsigned next = step;
+      // a stalled reading might be a fan too slow for the current scale
+      if(tach[i] >= AUTORANGE_HIGH && step > 0){
+        next = step - 1;
+      }else if(tach[i] < AUTORANGE_LOW && step + 1 < AUTORANGE_STEPS){
+        next = step + 1;
+      }
+      if(next != step){
+        if(autorange_fan(emc, i, next)){
+          ret = -1;
+        }else{
+          ch |= 1u << i;
+        }
+      }
+    }
+  }
+  if(changed){
+    *changed = ch;
+  }
+  return ret;
+}
+
+int emc230x_get_stats(const emc230x* emc, emc230x_stats* stats){
+#ifdef CONFIG_EMC230X_STATS
+  *stats = emc->stats;
+  return 0;
+#else
+  (void)emc;
+  (void)stats;
+  ESP_LOGE(TAG, "statistics require CONFIG_EMC230X_STATS");
+  return -1;
+#endif
+}
+
+void emc230x_reset_stats(emc230x* emc){
+#ifdef CONFIG_EMC230X_STATS
+  memset(&emc->stats, 0, sizeof(emc->stats));
+#else
+  (void)emc;
+#endif
+}
+
+int emc230x_set_retry_policy(emc230x* emc, const emc230x_retry_policy* policy){
+  if(policy == NULL){
+    emc->retry = default_policy;
+    return 0;
+  }
+  if(policy->trip_after && policy->cooldown_ms == 0){
+    ESP_LOGE(TAG, "circuit breaker requires a cooldown");
+    return -1;
+  }
+  // bounding attempts keeps the backoff shifts defined
+  if(policy->attempts > 16){
+    ESP_LOGE(TAG, "%u attempts exceeds the maximum of 16", policy->attempts);
+    return -1;
+  }
+  // the last retry's backoff, computed without overflowing
+  if(policy->attempts > 1 && policy->backoff_ms > 60000u >> (policy->attempts - 2)){
+    ESP_LOGE(TAG, "backoff of %ums over %u attempts is too long", policy->backoff_ms, policy->attempts);
+    return -1;
+  }
+  emc->retry = *policy;
+  return 0;
+}
+
+emc230x_error emc230x_last_error(const emc230x* emc){
+  return emc->lasterr;
+}
+
+void emc230x_get_health(const emc230x* emc, emc230x_health* health){
+  *health = emc->health;
 }
@@ -0,0 +1,209 @@
+#include "emc230x.h"
+#include <esp_log.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#define ALERT_STACK 3072
+#define ALERT_PRIORITY 10
+// bounds of the backoff between services while ALERT remains asserted
+#define ALERT_RECHECK_MIN_MS 10
+#define ALERT_RECHECK_MAX_MS 1000
+
+static const char* TAG = "emcalert";
+
+typedef struct emc230x_alert_handler {
+  emc230x_alert_cb cb;
+  void* arg;
+} emc230x_alert_handler;
+
+struct emc230x_alert {
+  int gpio;
+  TaskHandle_t task;
+  SemaphoreHandle_t done;   // given by the task upon exit
+  atomic_bool stopping;
+  // handlers are only ever appended: the entry is filled in before
+  // handlercount is advanced, so the task never sees a partial entry.
+  atomic_uint handlercount;
+  emc230x_alert_handler handlers[EMC230X_ALERT_MAXCB];
+  unsigned count;
+  emc230x* emcs[];
+};
+
+// ALERT is asserted low, and held until the status registers are read. all
+// the ISR does is wake the task.
+static void IRAM_ATTR
+alert_isr(void* arg){
+  emc230x_alert* a = arg;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(a->task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void
+dispatch(emc230x_alert* a, emc230x* emc, unsigned fanidx, unsigned events){
+  const unsigned handlers = atomic_load(&a->handlercount);
+  for(unsigned i = 0 ; i < handlers ; ++i){
+    a->handlers[i].cb(emc, fanidx, events, a->handlers[i].arg);
+  }
+}
+
+// read all status registers of each device on the line once, and report
+// whatever they contain. the read clears any bits whose condition has
+// passed, deasserting ALERT unless some fault persists.
+static void
+service_alert(emc230x_alert* a){
+  for(unsigned d = 0 ; d < a->count ; ++d){
+    emc230x* emc = a->emcs[d];
+    emc230x_status status;
+    if(emc230x_read_all_status(emc, &status)){
+      continue;
+    }
+    if(status.fanstatus & EMC230X_FSR_WATCH){
+      dispatch(a, emc, EMC230X_ALERT_DEVICE, EMC230X_EVENT_WATCHDOG);
+    }
+    const unsigned fans = emc230x_fancount(emc);
+    for(unsigned i = 0 ; i < fans ; ++i){
+      unsigned events = 0;
+      if(status.stall & (1u << i)){
+        events |= EMC230X_EVENT_STALL;
+      }
+      if(status.spin & (1u << i)){
+        events |= EMC230X_EVENT_SPIN;
+      }
+      if(status.drivefail & (1u << i)){
+        events |= EMC230X_EVENT_DRIVEFAIL;
+      }
+      if(events){
+        dispatch(a, emc, i, events);
+      }
+    }
+  }
+}
+
+// ALERT is a shared open-drain line, held low while any device asserts
+// it, so a fault which persists (or which another device or fan latches
+// during the service) produces no new falling edge. while the line remains
+// low after a service, service it again after a backoff, doubling up to
+// ALERT_RECHECK_MAX_MS. an edge still wakes the task immediately.
+static void
+alert_task(void* arg){
+  emc230x_alert* a = arg;
+  TickType_t wait = portMAX_DELAY;
+  unsigned backoff = ALERT_RECHECK_MIN_MS;
+  while(!atomic_load(&a->stopping)){
+    ulTaskNotifyTake(pdTRUE, wait);
+    if(atomic_load(&a->stopping)){
+      break;
+    }
+    service_alert(a);
+    if(gpio_get_level(a->gpio) == 0){
+      wait = pdMS_TO_TICKS(backoff);
+      backoff = backoff * 2 < ALERT_RECHECK_MAX_MS ? backoff * 2 : ALERT_RECHECK_MAX_MS;
+    }else{
+      wait = portMAX_DELAY;
+      backoff = ALERT_RECHECK_MIN_MS;
+    }
+  }
+  xSemaphoreGive(a->done);
+  vTaskDelete(NULL);
+}
+
+int emc230x_alert_start(int gpio, emc230x* const* emcs, unsigned count,
+                        emc230x_alert** alert){
+  if(count == 0){
+    ESP_LOGE(TAG, "no devices provided for alert on gpio %d", gpio);
+    return -1;
+  }
+  emc230x_alert* a = calloc(1, sizeof(*a) + count * sizeof(*a->emcs));
+  if(a == NULL){
+    ESP_LOGE(TAG, "couldn't allocate alert for %u devices", count);
+    return -1;
+  }
+  a->gpio = gpio;
+  a->count = count;
+  for(unsigned i = 0 ; i < count ; ++i){
+    a->emcs[i] = emcs[i];
+  }
+  atomic_init(&a->stopping, false);
+  atomic_init(&a->handlercount, 0);
+  if((a->done = xSemaphoreCreateBinary()) == NULL){
+    ESP_LOGE(TAG, "couldn't create alert semaphore");
+    goto err;
+  }
+  if(xTaskCreate(alert_task, "emc230xalert", ALERT_STACK, a,
+                 ALERT_PRIORITY, &a->task) != pdPASS){
+    ESP_LOGE(TAG, "couldn't create alert task");
+    goto err;
+  }
+  // ALERT is open drain, and can be shared among several devices
+  gpio_config_t gcfg = {
+    .pin_bit_mask = 1ull << gpio,
+    .mode = GPIO_MODE_INPUT,
+    .pull_up_en = GPIO_PULLUP_ENABLE,
+    .pull_down_en = GPIO_PULLDOWN_DISABLE,
+    .intr_type = GPIO_INTR_NEGEDGE,
+  };
+  esp_err_t e;
+  if((e = gpio_config(&gcfg)) != ESP_OK){
+    ESP_LOGE(TAG, "error (%s) configuring gpio %d", esp_err_to_name(e), gpio);
+    goto errtask;
+  }
+  // the ISR service might already have been installed by the application
+  e = gpio_install_isr_service(0);
+  if(e != ESP_OK && e != ESP_ERR_INVALID_STATE){
+    ESP_LOGE(TAG, "error (%s) installing gpio isr service", esp_err_to_name(e));
+    goto errtask;
+  }
+  if((e = gpio_isr_handler_add(gpio, alert_isr, a)) != ESP_OK){
+    ESP_LOGE(TAG, "error (%s) adding isr for gpio %d", esp_err_to_name(e), gpio);
+    goto errtask;
+  }
+  // ALERT might have been asserted before we were watching; service any
+  // such fault now, which will deassert it so that the next one is an edge.
+  if(gpio_get_level(gpio) == 0){
+    xTaskNotifyGive(a->task);
+  }
+  *alert = a;
+  return 0;
+
+errtask:
+  atomic_store(&a->stopping, true);
+  xTaskNotifyGive(a->task);
+  xSemaphoreTake(a->done, portMAX_DELAY);
+err:
+  if(a->done){
+    vSemaphoreDelete(a->done);
+  }
+  free(a);
+  return -1;
+}
+
+int emc230x_alert_add_callback(emc230x_alert* a, emc230x_alert_cb cb, void* arg){
+  unsigned n = atomic_load(&a->handlercount);
+  if(n == EMC230X_ALERT_MAXCB){
+    ESP_LOGE(TAG, "too many alert callbacks (%u)", n);
+    return -1;
+  }
+  a->handlers[n].cb = cb;
+  a->handlers[n].arg = arg;
+  atomic_store(&a->handlercount, n + 1);
+  return 0;
+}
+
+void emc230x_alert_stop(emc230x_alert* a){
+  if(a){
+    esp_err_t e = gpio_isr_handler_remove(a->gpio);
+    if(e != ESP_OK){
+      ESP_LOGW(TAG, "error (%s) removing isr for gpio %d", esp_err_to_name(e), a->gpio);
+    }
+    atomic_store(&a->stopping, true);
+    xTaskNotifyGive(a->task);
+    xSemaphoreTake(a->done, portMAX_DELAY);
+    vSemaphoreDelete(a->done);
+    free(a);
+  }
+}
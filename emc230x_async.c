@@ -0,0 +1,267 @@
+#include "emc230x.h"
+#include "emc230x_regs.h"
+#include <esp_log.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+static const char* TAG = "emcasync";
+
+// an operation in flight. its buffers must remain valid until the driver
+// completes it, so they live here rather than on the submitter's stack.
+typedef struct asyncop {
+  emc230x_async_result result;
+  emc230x_async_cb cb;
+  void* arg;
+  uint8_t wbuf[2];
+  uint8_t rbuf[4];
+} asyncop;
+
+// the I2C driver completes a device's transactions in the order they were
+// queued, so in-flight operations form a FIFO: the submitter appends at
+// tail, and the completion callback retires from head.
+struct emc230x_async {
+  emc230x* emc;
+  i2c_master_dev_handle_t dev;  // our own handle, in asynchronous mode
+  QueueHandle_t results;        // completions lacking a callback
+  unsigned depth;
+  atomic_uint head;
+  atomic_uint tail;
+  asyncop ops[];
+};
+
+// decode the completed operation's buffers into its result
+static void
+decode(asyncop* op){
+  emc230x_async_result* r = &op->result;
+  switch(r->op){
+    case EMC230X_ASYNC_GETTACH:
+      r->tach = tach_from_regs(op->rbuf[0], op->rbuf[1]);
+      break;
+    case EMC230X_ASYNC_READ_STATUS:
+      r->status.fanstatus = op->rbuf[0];
+      r->status.stall = op->rbuf[1];
+      r->status.spin = op->rbuf[2];
+      r->status.drivefail = op->rbuf[3];
+      break;
+    case EMC230X_ASYNC_SETPWM:
+      break;
+  }
+}
+
+// invoked by the I2C driver from its ISR upon each transaction's end
+static bool
+async_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t* evt, void* arg){
+  (void)dev;
+  emc230x_async* a = arg;
+  bool ok;
+  switch(evt->event){
+    case I2C_EVENT_DONE:
+      ok = true;
+      break;
+    case I2C_EVENT_NACK:
+    case I2C_EVENT_TIMEOUT:
+      ok = false;
+      break;
+    default:
+      return false; // still in progress
+  }
+  const unsigned head = atomic_load_explicit(&a->head, memory_order_relaxed);
+  if(head == atomic_load_explicit(&a->tail, memory_order_acquire)){
+    return false; // not ours
+  }
+  asyncop* op = &a->ops[head % a->depth];
+  op->result.ok = ok;
+  if(ok){
+    decode(op);
+  }
+  BaseType_t woken = pdFALSE;
+  // results lacking a callback are only queued. notifying the submitter
+  // would use its default notification, on which it might be waiting for
+  // something else.
+  if(op->cb){
+    op->cb(&op->result, op->arg);
+  }else{
+    xQueueSendFromISR(a->results, &op->result, &woken);
+  }
+  atomic_store_explicit(&a->head, head + 1, memory_order_release);
+  return woken == pdTRUE;
+}
+
+int emc230x_async_start(emc230x* emc, unsigned depth, emc230x_async** async){
+  // the synchronous API only waits for completions if it knows the bus to
+  // be asynchronous, and is otherwise broken by it
+  if(emc->xferwait == NULL){
+    ESP_LOGE(TAG, "device at 0x%02x not detected with async_bus", emc->address);
+    return -1;
+  }
+  if(depth == 0){
+    ESP_LOGE(TAG, "invalid async depth");
+    return -1;
+  }
+  emc230x_async* a = calloc(1, sizeof(*a) + depth * sizeof(*a->ops));
+  if(a == NULL){
+    ESP_LOGE(TAG, "couldn't allocate async state for depth %u", depth);
+    return -1;
+  }
+  a->emc = emc;
+  a->depth = depth;
+  atomic_init(&a->head, 0);
+  atomic_init(&a->tail, 0);
+  if((a->results = xQueueCreate(depth, sizeof(emc230x_async_result))) == NULL){
+    ESP_LOGE(TAG, "couldn't create result queue");
+    free(a);
+    return -1;
+  }
+  // the synchronous API's handle has its own completion callback, so we
+  // use a second handle, delivering only our completions to async_done().
+  i2c_device_config_t devcfg = {
+    .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+    .device_address = emc->address,
+    .scl_speed_hz = emc->scl_speed_hz,
+  };
+  esp_err_t e;
+  if((e = i2c_master_bus_add_device(emc->bus, &devcfg, &a->dev)) != ESP_OK){
+    ESP_LOGE(TAG, "error (%s) adding async device at 0x%02x", esp_err_to_name(e), emc->address);
+    goto err;
+  }
+  const i2c_master_event_callbacks_t cbs = {
+    .on_trans_done = async_done,
+  };
+  if((e = i2c_master_register_event_callbacks(a->dev, &cbs, a)) != ESP_OK){
+    ESP_LOGE(TAG, "error (%s) registering async callbacks", esp_err_to_name(e));
+    i2c_master_bus_rm_device(a->dev);
+    goto err;
+  }
+  *async = a;
+  return 0;
+
+err:
+  vQueueDelete(a->results);
+  free(a);
+  return -1;
+}
+
+// claim the slot at the tail of the FIFO, or return NULL if it's full
+static asyncop*
+claim(emc230x_async* a, emc230x_async_op kind, unsigned fanidx,
+      emc230x_async_cb cb, void* arg){
+  const unsigned tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+  if(tail - atomic_load_explicit(&a->head, memory_order_acquire) == a->depth){
+    ESP_LOGW(TAG, "%u operations already in flight", a->depth);
+    return NULL;
+  }
+  asyncop* op = &a->ops[tail % a->depth];
+  op->result = (emc230x_async_result){
+    .op = kind,
+    .fanidx = fanidx,
+  };
+  op->cb = cb;
+  op->arg = arg;
+  return op;
+}
+
+// publish the claimed slot before handing it to the driver, since it might
+// complete before the submission returns. if the submission fails, nothing
+// will complete it, and (with a single submitter) it is still the tail.
+static int
+submit(emc230x_async* a, esp_err_t (*fxn)(emc230x_async*, asyncop*), asyncop* op){
+  const unsigned tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+  atomic_store_explicit(&a->tail, tail + 1, memory_order_release);
+  esp_err_t e = fxn(a, op);
+  if(e != ESP_OK){
+    atomic_store_explicit(&a->tail, tail, memory_order_release);
+    ESP_LOGE(TAG, "error (%s) submitting async operation", esp_err_to_name(e));
+    return -1;
+  }
+  return 0;
+}
+
+static esp_err_t
+xmit_read(emc230x_async* a, asyncop* op){
+  const size_t rlen = op->result.op == EMC230X_ASYNC_GETTACH ? 2 : 4;
+  return i2c_master_transmit_receive(a->dev, op->wbuf, 1, op->rbuf, rlen,
+                                     a->emc->timeout_ms);
+}
+
+static esp_err_t
+xmit_write(emc230x_async* a, asyncop* op){
+  return i2c_master_transmit(a->dev, op->wbuf, 2, a->emc->timeout_ms);
+}
+
+int emc230x_async_gettach(emc230x_async* a, unsigned fanidx,
+                          emc230x_async_cb cb, void* arg){
+  if(fanidx >= emc230x_fancount(a->emc)){
+    ESP_LOGE(TAG, "invalid fan index %u", fanidx);
+    return -1;
+  }
+  asyncop* op = claim(a, EMC230X_ASYNC_GETTACH, fanidx, cb, arg);
+  if(op == NULL){
+    return -1;
+  }
+  op->wbuf[0] = EMCREG_TACH1READHIGH + 16 * fanidx;
+  return submit(a, xmit_read, op);
+}
+
+int emc230x_async_setpwm(emc230x_async* a, unsigned fanidx, uint8_t pwm,
+                         emc230x_async_cb cb, void* arg){
+  if(fanidx >= emc230x_fancount(a->emc)){
+    ESP_LOGE(TAG, "invalid fan index %u", fanidx);
+    return -1;
+  }
+  asyncop* op = claim(a, EMC230X_ASYNC_SETPWM, fanidx, cb, arg);
+  if(op == NULL){
+    return -1;
+  }
+  op->wbuf[0] = EMCREG_FAN1SETTING + 16 * fanidx;
+  op->wbuf[1] = pwm;
+  return submit(a, xmit_write, op);
+}
+
+int emc230x_async_read_status(emc230x_async* a, emc230x_async_cb cb, void* arg){
+  asyncop* op = claim(a, EMC230X_ASYNC_READ_STATUS, 0, cb, arg);
+  if(op == NULL){
+    return -1;
+  }
+  op->wbuf[0] = EMCREG_FANSTATUS;
+  return submit(a, xmit_read, op);
+}
+
+int emc230x_async_poll(emc230x_async* a, emc230x_async_result* result,
+                       unsigned timeout_ms){
+  if(xQueueReceive(a->results, result, pdMS_TO_TICKS(timeout_ms)) != pdTRUE){
+    return -1;
+  }
+  return 0;
+}
+
+unsigned emc230x_async_inflight(const emc230x_async* a){
+  emc230x_async* m = (emc230x_async*)a;
+  return atomic_load(&m->tail) - atomic_load(&m->head);
+}
+
+int emc230x_async_stop(emc230x_async* a, unsigned timeout_ms){
+  if(a == NULL){
+    return 0;
+  }
+  // let everything in flight complete, so that no callback refers to
+  // freed state
+  const TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+  for(TickType_t t = 0 ; emc230x_async_inflight(a) ; ++t){
+    if(t == ticks){
+      ESP_LOGE(TAG, "%u operations still in flight after %ums",
+               emc230x_async_inflight(a), timeout_ms);
+      return -1;
+    }
+    vTaskDelay(1);
+  }
+  esp_err_t e = i2c_master_bus_rm_device(a->dev);
+  if(e != ESP_OK){
+    ESP_LOGW(TAG, "error (%s) removing async device", esp_err_to_name(e));
+  }
+  vQueueDelete(a->results);
+  free(a);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include "emc230x.h"
+#include <esp_log.h>
+#include <string.h>
+
+static const char* TAG = "emccurve";
+
+int emc230x_curve_build(emc230x_curve* curve, const emc230x_curve_point* pts,
+                        unsigned count){
+  if(count == 0){
+    ESP_LOGE(TAG, "no curve points provided");
+    return -1;
+  }
+  for(unsigned i = 1 ; i < count ; ++i){
+    if(pts[i].temp_c <= pts[i - 1].temp_c){
+      ESP_LOGE(TAG, "curve points must strictly ascend in temperature (%u)", i);
+      return -1;
+    }
+  }
+  // flat below the first point and above the last, linearly interpolated
+  // (rounding to nearest) between them.
+  unsigned p = 0;
+  for(unsigned t = 0 ; t < EMC230X_CURVE_ENTRIES ; ++t){
+    while(p < count && pts[p].temp_c <= t){
+      ++p;
+    }
+    if(p == 0){
+      curve->lut[t] = pts[0].pwm;
+    }else if(p == count){
+      curve->lut[t] = pts[count - 1].pwm;
+    }else{
+      const emc230x_curve_point* a = &pts[p - 1];
+      const emc230x_curve_point* b = &pts[p];
+      const int span = b->temp_c - a->temp_c;
+      const int rise = (b->pwm - a->pwm) * (int)(t - a->temp_c);
+      curve->lut[t] = a->pwm + (rise >= 0 ? rise + span / 2 : rise - span / 2) / span;
+    }
+  }
+  return 0;
+}
+
+void emc230x_curves_init(emc230x_curves* cs, const emc230x* emc){
+  memset(cs, 0, sizeof(*cs));
+  cs->emc = emc;
+}
+
+int emc230x_curves_assign(emc230x_curves* cs, unsigned fanidx,
+                          const emc230x_curve* curve, unsigned hysteresis_c){
+  if(fanidx >= emc230x_fancount(cs->emc)){
+    ESP_LOGE(TAG, "invalid fan index %u", fanidx);
+    return -1;
+  }
+  if(hysteresis_c >= EMC230X_CURVE_ENTRIES){
+    ESP_LOGE(TAG, "invalid hysteresis %u for fan %u", hysteresis_c, fanidx);
+    return -1;
+  }
+  cs->curves[fanidx] = curve;
+  cs->hysteresis[fanidx] = hysteresis_c;
+  // force evaluation and a write upon the next update
+  cs->valid &= ~(1u << fanidx);
+  return 0;
+}
+
+// clamp a temperature to the domain of the table
+static inline uint8_t
+curve_index(int temp_c){
+  if(temp_c < 0){
+    return 0;
+  }
+  if(temp_c >= EMC230X_CURVE_ENTRIES){
+    return EMC230X_CURVE_ENTRIES - 1;
+  }
+  return temp_c;
+}
+
+int emc230x_curves_update(emc230x_curves* cs, const int temps_c[EMC230X_MAXFANS],
+                          unsigned* written){
+  const unsigned fans = emc230x_fancount(cs->emc);
+  uint8_t pwm[EMC230X_MAXFANS];
+  unsigned mask = 0;
+  for(unsigned i = 0 ; i < fans ; ++i){
+    const emc230x_curve* c = cs->curves[i];
+    if(c == NULL){
+      continue;
+    }
+    const uint8_t t = curve_index(temps_c[i]);
+    const unsigned bit = 1u << i;
+    // follow rising temperatures immediately, but falling ones only once
+    // they've dropped by the hysteresis, so that noise about a breakpoint
+    // doesn't dither the output.
+    if(!(cs->valid & bit) || t > cs->temp[i] || t + cs->hysteresis[i] <= cs->temp[i]){
+      cs->temp[i] = t;
+    }
+    pwm[i] = c->lut[cs->temp[i]];
+    if(!(cs->valid & bit) || pwm[i] != cs->pwm[i]){
+      mask |= bit;
+    }
+  }
+  if(written){
+    *written = 0;
+  }
+  if(mask == 0){
+    return 0;
+  }
+  if(emc230x_setpwm_all(cs->emc, pwm, mask)){
+    // leave the cached outputs alone, so the next update retries
+    return -1;
+  }
+  for(unsigned i = 0 ; i < fans ; ++i){
+    if(mask & (1u << i)){
+      cs->pwm[i] = pwm[i];
+    }
+  }
+  cs->valid |= mask;
+  if(written){
+    *written = mask;
+  }
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include "emc230x.h"
+#include "emc230x_regs.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+
+static const char* TAG = "emcgroup";
+
+int emc230x_group_init(emc230x_group* g, emc230x* const* emcs, unsigned count){
+  if(count == 0 || count > EMC230X_GROUP_MAX){
+    ESP_LOGE(TAG, "invalid group size %u", count);
+    return -1;
+  }
+  memset(g, 0, sizeof(*g));
+  for(unsigned i = 0 ; i < count ; ++i){
+    if(emcs[i]->bus != emcs[0]->bus){
+      ESP_LOGE(TAG, "group members must share a bus");
+      return -1;
+    }
+    for(unsigned j = 0 ; j < i ; ++j){
+      if(emcs[i]->address == emcs[j]->address){
+        ESP_LOGE(TAG, "duplicate address 0x%02x in group", emcs[i]->address);
+        return -1;
+      }
+    }
+  }
+  // the first member drives its clock onto CLK, and the others run from
+  // it, so that all PWM outputs share a timebase.
+  if(emc230x_set_clockoutput(emcs[0])){
+    return -1;
+  }
+  for(unsigned i = 1 ; i < count ; ++i){
+    if(emc230x_set_clockinput(emcs[i])){
+      return -1;
+    }
+  }
+  // encode a write of each fan's setting, leaving only the values to be
+  // filled in. the address bytes are part of the buffers, so that writes
+  // to every member can be chained with repeated STARTs into a single
+  // transaction on the first member's handle.
+  unsigned o = 0;
+  for(unsigned i = 0 ; i < count ; ++i){
+    g->emcs[i] = emcs[i];
+    const unsigned fans = emc230x_fancount(emcs[i]);
+    for(unsigned f = 0 ; f < fans ; ++f){
+      uint8_t* w = g->wbufs[g->fans++];
+      w[0] = emcs[i]->address << 1u;
+      w[1] = EMCREG_FAN1SETTING + 16 * f;
+#ifdef EMC230X_DEFINED_OPS
+      g->ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_START, };
+      g->ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_WRITE,
+        .write = { .ack_check = true, .data = w, .total_bytes = 3, }, };
+#endif
+    }
+  }
+#ifdef EMC230X_DEFINED_OPS
+  g->ops[o++] = (i2c_operation_job_t){ .command = I2C_MASTER_CMD_STOP, };
+#endif
+  g->opcount = o;
+  g->count = count;
+  return 0;
+}
+
+unsigned emc230x_group_fancount(const emc230x_group* g){
+  return g->fans;
+}
+
+#ifdef EMC230X_DEFINED_OPS
+int emc230x_group_setpwm(emc230x_group* g, const uint8_t* pwm, int64_t* skew_us){
+  for(unsigned i = 0 ; i < g->fans ; ++i){
+    g->wbufs[i][2] = pwm[i];
+  }
+  // the burst goes out on the first member's handle, subject to its retry
+  // policy and circuit breaker. rewriting every setting is harmless, so a
+  // failed burst can simply be retried whole.
+  const int64_t t0 = esp_timer_get_time();
+  if(emc230x_execute_ops(g->emcs[0], g->ops, g->opcount, 2 * g->fans)){
+    ESP_LOGE(TAG, "error writing %u group PWM settings", g->fans);
+    return -1;
+  }
+  const int64_t t1 = esp_timer_get_time();
+  if(skew_us){
+    *skew_us = t1 - t0;
+  }
+  return 0;
+}
+#else
+// without custom transaction sequences, each member is written in turn,
+// as tightly as the driver allows.
+int emc230x_group_setpwm(emc230x_group* g, const uint8_t* pwm, int64_t* skew_us){
+  const int64_t t0 = esp_timer_get_time();
+  unsigned f = 0;
+  for(unsigned i = 0 ; i < g->count ; ++i){
+    const emc230x* emc = g->emcs[i];
+    const unsigned fans = emc230x_fancount(emc);
+    uint8_t vals[EMC230X_MAXFANS];
+    for(unsigned j = 0 ; j < fans ; ++j){
+      vals[j] = pwm[f++];
+    }
+    if(emc230x_setpwm_all(emc, vals, (1u << fans) - 1)){
+      return -1;
+    }
+  }
+  if(skew_us){
+    *skew_us = esp_timer_get_time() - t0;
+  }
+  return 0;
+}
+#endif
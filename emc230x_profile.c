@@ -0,0 +1,239 @@
+#include "emc230x.h"
+#include <esp_log.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define DEFAULT_SETTLE_MS 2000
+
+// serialized form: magic, version, fan count, PROFILE_FAN_BYTES per fan,
+// and a CRC-8 over everything preceding it. multibyte fields are little-
+// endian.
+#define PROFILE_MAGIC 0xec
+#define PROFILE_VERSION 1
+#define PROFILE_HEADER_BYTES 3
+#define PROFILE_FAN_BYTES (6 + 2 * EMC230X_PROFILE_POINTS)
+
+static const char* TAG = "emcprofile";
+
+// the PWM setting at which sweep point i is taken: 0x00, 0x10, ..., 0xf0,
+// and finally 0xff.
+static inline uint8_t
+point_pwm(unsigned i){
+  return i == EMC230X_PROFILE_POINTS - 1 ? 0xff : i * 16;
+}
+
+int emc230x_characterize(emc230x* emc, unsigned mask, unsigned settle_ms,
+                         emc230x_profile* prof){
+  const unsigned fans = emc230x_fancount(emc);
+  if(mask == 0 || mask >> fans){
+    ESP_LOGE(TAG, "invalid fan mask 0x%02x (%u fans)", mask, fans);
+    return -1;
+  }
+  if(settle_ms == 0){
+    settle_ms = DEFAULT_SETTLE_MS;
+  }
+  uint8_t saved[EMC230X_MAXFANS];
+  for(unsigned i = 0 ; i < fans ; ++i){
+    if((mask & (1u << i)) && emc230x_getpwm(emc, i, &saved[i])){
+      return -1;
+    }
+  }
+  memset(prof, 0, sizeof(*prof));
+  prof->fans = fans;
+  // sweep downward from full drive, so that each point is approached from
+  // a running fan (a stopped fan needs more drive to start than a running
+  // one needs to keep turning). fans drop out of the sweep once stalled.
+  unsigned sweeping = mask;
+  int ret = 0;
+  for(int p = EMC230X_PROFILE_POINTS - 1 ; p >= 0 && sweeping ; --p){
+    uint8_t pwm[EMC230X_MAXFANS];
+    memset(pwm, point_pwm(p), sizeof(pwm));
+    unsigned tach[EMC230X_MAXFANS];
+    if(emc230x_setpwm_all(emc, pwm, sweeping)){
+      ret = -1;
+      break;
+    }
+    vTaskDelay(pdMS_TO_TICKS(settle_ms));
+    if(emc230x_gettach_all_opt(emc, true, tach)){
+      ret = -1;
+      break;
+    }
+    for(unsigned i = 0 ; i < fans ; ++i){
+      if(!(sweeping & (1u << i))){
+        continue;
+      }
+      emc230x_fanprofile* fp = &prof->fan[i];
+      unsigned rpm;
+      emc230x_tach_to_rpm(emc, i, tach[i], &rpm);
+      if(rpm > UINT16_MAX){
+        rpm = UINT16_MAX;
+      }
+      fp->rpm[p] = rpm;
+      if(rpm){
+        fp->stall_pwm = point_pwm(p);
+      }else{
+        sweeping &= ~(1u << i);
+      }
+    }
+  }
+  for(unsigned i = 0 ; i < fans ; ++i){
+    if(!(mask & (1u << i))){
+      continue;
+    }
+    // leave a step of margin above the stall point, where the fan is
+    // reliably turning
+    emc230x_fanprofile* fp = &prof->fan[i];
+    fp->max_rpm = fp->rpm[EMC230X_PROFILE_POINTS - 1];
+    if(fp->max_rpm == 0){
+      ESP_LOGW(TAG, "fan %u never turned", i);
+      continue;
+    }
+    unsigned p = fp->stall_pwm / 16 + 1;
+    if(p >= EMC230X_PROFILE_POINTS){
+      p = EMC230X_PROFILE_POINTS - 1;
+    }
+    fp->mindrive = point_pwm(p);
+    fp->min_rpm = fp->rpm[p];
+  }
+  if(emc230x_setpwm_all(emc, saved, mask)){
+    ret = -1;
+  }
+  return ret;
+}
+
+int emc230x_profile_rpm(const emc230x_profile* prof, unsigned fanidx,
+                        uint8_t pwm, unsigned* rpm){
+  if(fanidx >= prof->fans){
+    ESP_LOGE(TAG, "invalid fan index %u", fanidx);
+    return -1;
+  }
+  const emc230x_fanprofile* fp = &prof->fan[fanidx];
+  if(pwm < fp->stall_pwm || fp->max_rpm == 0){
+    *rpm = 0;
+    return 0;
+  }
+  const unsigned p = pwm / 16 < EMC230X_PROFILE_POINTS - 2 ? pwm / 16 : EMC230X_PROFILE_POINTS - 2;
+  const unsigned x0 = point_pwm(p);
+  const unsigned x1 = point_pwm(p + 1);
+  const int y0 = fp->rpm[p];
+  const int y1 = fp->rpm[p + 1];
+  *rpm = y0 + (y1 - y0) * (int)(pwm - x0) / (int)(x1 - x0);
+  return 0;
+}
+
+int emc230x_profile_apply(emc230x* emc, const emc230x_profile* prof){
+  const unsigned fans = emc230x_fancount(emc);
+  if(prof->fans != fans){
+    ESP_LOGE(TAG, "profile is for %u fans, device has %u", prof->fans, fans);
+    return -1;
+  }
+  const bool ownbatch = !emc->batching;
+  if(ownbatch && emc230x_config_begin(emc)){
+    return -1;
+  }
+  for(unsigned i = 0 ; i < fans ; ++i){
+    const emc230x_fanprofile* fp = &prof->fan[i];
+    if(fp->max_rpm == 0){
+      continue;
+    }
+    // flag a stall below three quarters of the slowest reliable speed,
+    // and a drive fail when full drive can't get within 10% of the
+    // characterized maximum.
+    unsigned tmax, t90;
+    if(emc230x_rpm_to_tach(emc, i, fp->max_rpm, &tmax) ||
+        emc230x_rpm_to_tach(emc, i, fp->max_rpm * 9 / 10, &t90) ||
+        emc230x_set_mindrive(emc, i, fp->mindrive) ||
+        emc230x_set_min_rpm(emc, i, fp->min_rpm * 3 / 4) ||
+        emc230x_set_drivefail_band(emc, i, t90 - tmax)){
+      if(ownbatch){
+        emc230x_config_abort(emc);
+      }
+      return -1;
+    }
+  }
+  if(ownbatch){
+    return emc230x_config_commit(emc);
+  }
+  return 0;
+}
+
+// CRC-8 with polynomial 0x07
+static uint8_t
+crc8(const uint8_t* buf, size_t len){
+  uint8_t crc = 0;
+  for(size_t i = 0 ; i < len ; ++i){
+    crc ^= buf[i];
+    for(unsigned b = 0 ; b < 8 ; ++b){
+      crc = crc & 0x80 ? (crc << 1u) ^ 0x07 : crc << 1u;
+    }
+  }
+  return crc;
+}
+
+static inline uint8_t*
+put16(uint8_t* b, uint16_t v){
+  b[0] = v & 0xff;
+  b[1] = v >> 8u;
+  return b + 2;
+}
+
+static inline uint16_t
+get16(const uint8_t* b){
+  return b[0] | (b[1] << 8u);
+}
+
+int emc230x_profile_serialize(const emc230x_profile* prof, uint8_t* buf,
+                              size_t len, size_t* used){
+  const size_t need = PROFILE_HEADER_BYTES + prof->fans * PROFILE_FAN_BYTES + 1;
+  if(prof->fans > EMC230X_MAXFANS || len < need){
+    ESP_LOGE(TAG, "need %zuB to serialize profile, have %zuB", need, len);
+    return -1;
+  }
+  uint8_t* b = buf;
+  *b++ = PROFILE_MAGIC;
+  *b++ = PROFILE_VERSION;
+  *b++ = prof->fans;
+  for(unsigned i = 0 ; i < prof->fans ; ++i){
+    const emc230x_fanprofile* fp = &prof->fan[i];
+    *b++ = fp->stall_pwm;
+    *b++ = fp->mindrive;
+    b = put16(b, fp->min_rpm);
+    b = put16(b, fp->max_rpm);
+    for(unsigned p = 0 ; p < EMC230X_PROFILE_POINTS ; ++p){
+      b = put16(b, fp->rpm[p]);
+    }
+  }
+  *b = crc8(buf, b - buf);
+  *used = need;
+  return 0;
+}
+
+int emc230x_profile_deserialize(emc230x_profile* prof, const uint8_t* buf,
+                                size_t len){
+  if(len < PROFILE_HEADER_BYTES + 1 || buf[0] != PROFILE_MAGIC ||
+      buf[1] != PROFILE_VERSION || buf[2] > EMC230X_MAXFANS){
+    ESP_LOGE(TAG, "not a valid profile");
+    return -1;
+  }
+  const size_t need = PROFILE_HEADER_BYTES + buf[2] * PROFILE_FAN_BYTES + 1;
+  if(len < need || crc8(buf, need - 1) != buf[need - 1]){
+    ESP_LOGE(TAG, "truncated or corrupt profile");
+    return -1;
+  }
+  memset(prof, 0, sizeof(*prof));
+  prof->fans = buf[2];
+  const uint8_t* b = buf + PROFILE_HEADER_BYTES;
+  for(unsigned i = 0 ; i < prof->fans ; ++i){
+    emc230x_fanprofile* fp = &prof->fan[i];
+    fp->stall_pwm = b[0];
+    fp->mindrive = b[1];
+    fp->min_rpm = get16(b + 2);
+    fp->max_rpm = get16(b + 4);
+    b += 6;
+    for(unsigned p = 0 ; p < EMC230X_PROFILE_POINTS ; ++p, b += 2){
+      fp->rpm[p] = get16(b);
+    }
+  }
+  return 0;
+}
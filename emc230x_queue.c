@@ -0,0 +1,260 @@
+#include "emc230x.h"
+#include <esp_log.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#define QUEUE_STACK 3072
+#define QUEUE_PRIORITY 5
+
+static const char* TAG = "emcqueue";
+
+// commands internal to the queue, beyond the public emc230x_cmd_op
+#define QCMD_SYNC (EMC230X_CMD_WATCHDOG + 1)
+#define QCMD_STOP (EMC230X_CMD_WATCHDOG + 2)
+
+// the completion of a QCMD_SYNC, shared by the waiter and the worker. it is
+// freed by whichever of them is done with it last, so that the waiter can
+// time out and return while the worker still holds it. each sync having its
+// own completion, a late one can't satisfy a later sync.
+typedef struct qsync {
+  SemaphoreHandle_t done;
+  atomic_uint refs;
+} qsync;
+
+typedef struct qcmd {
+  unsigned op;
+  unsigned fanidx;
+  unsigned value;
+  qsync* sync;          // given following a QCMD_SYNC flush
+} qcmd;
+
+struct emc230x_queue {
+  emc230x* emc;
+  QueueHandle_t cmds;
+  TaskHandle_t task;
+  SemaphoreHandle_t done;   // given by the worker upon exit
+  atomic_uint errors;
+};
+
+// writes accumulated from a run of commands. PWM settings and targets are
+// unlocked registers written outside the configuration batch, so we coalesce
+// them ourselves; locked registers coalesce within the batch.
+typedef struct pending {
+  unsigned pwmmask;
+  uint8_t pwm[EMC230X_MAXFANS];
+  unsigned targmask;
+  unsigned rpm[EMC230X_MAXFANS];
+} pending;
+
+static void
+qsync_put(qsync* s){
+  if(atomic_fetch_sub(&s->refs, 1) == 1){
+    vSemaphoreDelete(s->done);
+    free(s);
+  }
+}
+
+// apply a command to the pending state, or to the open configuration batch.
+static int
+apply(emc230x* emc, pending* p, const qcmd* c){
+  switch(c->op){
+    case EMC230X_CMD_SETPWM:
+      p->pwm[c->fanidx] = c->value;
+      p->pwmmask |= 1u << c->fanidx;
+      return 0;
+    case EMC230X_CMD_TARGET_RPM:
+      p->rpm[c->fanidx] = c->value;
+      p->targmask |= 1u << c->fanidx;
+      return 0;
+    case EMC230X_CMD_ENABLE_FSC:
+      return emc230x_enable_fsc(emc, c->fanidx, c->value);
+    case EMC230X_CMD_INTERRUPT:
+      return emc230x_set_interrupt(emc, c->fanidx, c->value);
+    case EMC230X_CMD_PWMPOLARITY:
+      return emc230x_set_pwmpolarity(emc, c->fanidx, c->value);
+    case EMC230X_CMD_PWMOUTPUT:
+      return emc230x_set_pwmoutput(emc, c->fanidx, c->value);
+    case EMC230X_CMD_PWMBASEFREQ:
+      return emc230x_set_pwmbasefreq(emc, c->fanidx, c->value);
+    case EMC230X_CMD_ALERTMASK:
+      return emc230x_set_alertmask(emc, c->value);
+    case EMC230X_CMD_WATCHDOG:
+      return emc230x_set_watchdog(emc, c->value);
+  }
+  return -1;
+}
+
+// write out everything accumulated: tach targets first, so that FSC being
+// enabled in the same run drives toward the new target, then the locked
+// registers in a single unlock/lock bracket, and finally the PWM settings.
+static int
+flush(emc230x* emc, pending* p){
+  int ret = 0;
+  for(unsigned i = 0 ; i < EMC230X_MAXFANS ; ++i){
+    if(p->targmask & (1u << i)){
+      if(emc230x_set_target_rpm(emc, i, p->rpm[i])){
+        ret = -1;
+      }
+    }
+  }
+  if(emc230x_config_commit(emc)){
+    ret = -1;
+  }
+  if(p->pwmmask){
+    if(emc230x_setpwm_all(emc, p->pwm, p->pwmmask)){
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
+static void
+queue_task(void* arg){
+  emc230x_queue* q = arg;
+  qcmd c;
+  bool stopping = false;
+  while(!stopping){
+    xQueueReceive(q->cmds, &c, portMAX_DELAY);
+    pending p = { .pwmmask = 0, .targmask = 0, };
+    qsync* waiters[2];
+    unsigned waitercount = 0;
+    emc230x_config_begin(q->emc);
+    // drain whatever has accumulated, stopping at a sync once we have two
+    // waiters (or any stop), so that we needn't track an arbitrary number.
+    do{
+      if(c.op == QCMD_STOP){
+        stopping = true;
+      }else if(c.op == QCMD_SYNC){
+        waiters[waitercount++] = c.sync;
+      }else if(apply(q->emc, &p, &c)){
+        atomic_fetch_add(&q->errors, 1);
+      }
+    }while(!stopping && waitercount < sizeof(waiters) / sizeof(*waiters) &&
+           xQueueReceive(q->cmds, &c, 0) == pdTRUE);
+    if(flush(q->emc, &p)){
+      atomic_fetch_add(&q->errors, 1);
+    }
+    for(unsigned i = 0 ; i < waitercount ; ++i){
+      xSemaphoreGive(waiters[i]->done);
+      qsync_put(waiters[i]);
+    }
+  }
+  xSemaphoreGive(q->done);
+  vTaskDelete(NULL);
+}
+
+int emc230x_queue_start(emc230x* emc, unsigned depth, emc230x_queue** queue){
+  if(depth == 0){
+    ESP_LOGE(TAG, "invalid queue depth");
+    return -1;
+  }
+  emc230x_queue* q = calloc(1, sizeof(*q));
+  if(q == NULL){
+    ESP_LOGE(TAG, "couldn't allocate queue");
+    return -1;
+  }
+  q->emc = emc;
+  atomic_init(&q->errors, 0);
+  if((q->cmds = xQueueCreate(depth, sizeof(qcmd))) == NULL){
+    ESP_LOGE(TAG, "couldn't create command queue of depth %u", depth);
+    goto err;
+  }
+  if((q->done = xSemaphoreCreateBinary()) == NULL){
+    ESP_LOGE(TAG, "couldn't create queue semaphore");
+    goto err;
+  }
+  if(xTaskCreate(queue_task, "emc230xq", QUEUE_STACK, q, QUEUE_PRIORITY, &q->task) != pdPASS){
+    ESP_LOGE(TAG, "couldn't create queue task");
+    goto err;
+  }
+  *queue = q;
+  return 0;
+
+err:
+  if(q->done){
+    vSemaphoreDelete(q->done);
+  }
+  if(q->cmds){
+    vQueueDelete(q->cmds);
+  }
+  free(q);
+  return -1;
+}
+
+int emc230x_queue_submit(emc230x_queue* q, const emc230x_cmd* cmd){
+  if(cmd->op > EMC230X_CMD_WATCHDOG){
+    ESP_LOGE(TAG, "invalid command %d", cmd->op);
+    return -1;
+  }
+  if(cmd->op < EMC230X_CMD_ALERTMASK && cmd->fanidx >= emc230x_fancount(q->emc)){
+    ESP_LOGE(TAG, "invalid fan index %u", cmd->fanidx);
+    return -1;
+  }
+  if(cmd->op == EMC230X_CMD_SETPWM && cmd->value > UINT8_MAX){
+    ESP_LOGE(TAG, "invalid PWM setting %u", cmd->value);
+    return -1;
+  }
+  qcmd c = {
+    .op = cmd->op,
+    .fanidx = cmd->fanidx,
+    .value = cmd->value,
+    .sync = NULL,
+  };
+  if(xQueueSend(q->cmds, &c, 0) != pdTRUE){
+    ESP_LOGW(TAG, "command queue full");
+    return -1;
+  }
+  return 0;
+}
+
+int emc230x_queue_setpwm(emc230x_queue* q, unsigned fanidx, uint8_t pwm){
+  const emc230x_cmd cmd = {
+    .op = EMC230X_CMD_SETPWM,
+    .fanidx = fanidx,
+    .value = pwm,
+  };
+  return emc230x_queue_submit(q, &cmd);
+}
+
+int emc230x_queue_sync(emc230x_queue* q, unsigned timeout_ms){
+  qsync* s = malloc(sizeof(*s));
+  if(s == NULL || (s->done = xSemaphoreCreateBinary()) == NULL){
+    ESP_LOGE(TAG, "couldn't allocate sync");
+    free(s);
+    return -1;
+  }
+  atomic_init(&s->refs, 2);
+  qcmd c = {
+    .op = QCMD_SYNC,
+    .sync = s,
+  };
+  if(xQueueSend(q->cmds, &c, pdMS_TO_TICKS(timeout_ms)) != pdTRUE){
+    vSemaphoreDelete(s->done);
+    free(s);
+    return -1;
+  }
+  const bool done = xSemaphoreTake(s->done, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+  qsync_put(s);
+  return done ? 0 : -1;
+}
+
+unsigned emc230x_queue_errors(const emc230x_queue* q){
+  return atomic_load(&((emc230x_queue*)q)->errors);
+}
+
+void emc230x_queue_stop(emc230x_queue* q){
+  if(q){
+    qcmd c = {
+      .op = QCMD_STOP,
+    };
+    xQueueSend(q->cmds, &c, portMAX_DELAY);
+    xSemaphoreTake(q->done, portMAX_DELAY);
+    vSemaphoreDelete(q->done);
+    vQueueDelete(q->cmds);
+    free(q);
+  }
+}
@@ -0,0 +1,133 @@
+#ifndef DANKAMONGMEN_EMC230X_REGS
+#define DANKAMONGMEN_EMC230X_REGS
+
+// the register map and transfer helpers, shared among the component's
+// sources. this is not part of the public API.
+
+#include <stdint.h>
+#include <esp_idf_version.h>
+#include "emc230x.h"
+
+// ESP-IDF 5.4 introduced custom transaction sequences, allowing several
+// register accesses to be chained with repeated STARTs.
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0)
+#define EMC230X_DEFINED_OPS
+#endif
+
+// software locked registers cannot be modified unless the LOCK bit (LSB
+// of EMCREG_SOFTWARELOCK) is zero.
+typedef enum {
+  // configuration register is 0x40 on reset (DIS_TO set, MASK/WD_EN/DRESK/USECK unset)
+  EMCREG_CONFIGURATION = 0x20,      // software locked
+  EMCREG_FANSTATUS = 0x24,
+  EMCREG_STALLSTATUS = 0x25,
+  EMCREG_SPINSTATUS = 0x26,
+  EMCREG_DRIVESTATUS = 0x27,
+  EMCREG_FANINTR = 0x29,
+  EMCREG_PWMPOLARITY = 0x2a,
+  EMCREG_PWMOUTPUT = 0x2b,
+  EMCREG_PWMBASE45 = 0x2c,
+  EMCREG_PWMBASE123 = 0x2d,
+  EMCREG_FAN1SETTING = 0x30,
+  EMCREG_PWM1DIVIDE = 0x31,
+  EMCREG_FAN1CONF1 = 0x32,
+  EMCREG_FAN1CONF2 = 0x33,          // software locked
+  EMCREG_GAIN1 = 0x35,              // software locked
+  EMCREG_FAN1SPINUP = 0x36,         // software locked
+  EMCREG_FAN1MAXSTEP = 0x37,        // software locked
+  EMCREG_FAN1MINDRIVE = 0x38,       // software locked
+  EMCREG_FAN1VALIDTACH = 0x39,      // software locked
+  EMCREG_FAN1FAILLOW = 0x3a,        // software locked
+  EMCREG_FAN1FAILHIGH = 0x3b,       // software locked
+  EMCREG_TACH1TARGLOW = 0x3c,
+  EMCREG_TACH1TARGHIGH = 0x3d,
+  EMCREG_TACH1READHIGH = 0x3e,
+  EMCREG_TACH1READLOW = 0x3f,
+  // fan2 registers are only supported on emc230[235]
+  EMCREG_FAN2SETTING = 0x40,
+  EMCREG_PWM2DIVIDE = 0x41,
+  EMCREG_FAN2CONF1 = 0x42,
+  EMCREG_FAN2CONF2 = 0x43,
+  EMCREG_GAIN2 = 0x45,
+  EMCREG_FAN2SPINUP = 0x46,
+  EMCREG_FAN2MAXSTEP = 0x47,
+  EMCREG_FAN2MINDRIVE = 0x48,
+  EMCREG_FAN2VALIDTACH = 0x49,
+  EMCREG_FAN2FAILLOW = 0x4a,
+  EMCREG_FAN2FAILHIGH = 0x4b,
+  EMCREG_TACH2TARGLOW = 0x4c,
+  EMCREG_TACH2TARGHIGH = 0x4d,
+  EMCREG_TACH2READHIGH = 0x4e,
+  EMCREG_TACH2READLOW = 0x4f,
+  // fan3 registers are only supported on emc230[35]
+  EMCREG_FAN3SETTING = 0x50,
+  EMCREG_PWM3DIVIDE = 0x51,
+  EMCREG_FAN3CONF1 = 0x52,
+  EMCREG_FAN3CONF2 = 0x53,
+  EMCREG_GAIN3 = 0x55,
+  EMCREG_FAN3SPINUP = 0x56,
+  EMCREG_FAN3MAXSTEP = 0x57,
+  EMCREG_FAN3MINDRIVE = 0x58,
+  EMCREG_FAN3VALIDTACH = 0x59,
+  EMCREG_FAN3FAILLOW = 0x5a,
+  EMCREG_FAN3FAILHIGH = 0x5b,
+  EMCREG_TACH3TARGLOW = 0x5c,
+  EMCREG_TACH3TARGHIGH = 0x5d,
+  EMCREG_TACH3READHIGH = 0x5e,
+  EMCREG_TACH3READLOW = 0x5f,
+  // fan4 and fan5 registers are only supported on emc2305
+  EMCREG_FAN4SETTING = 0x60,
+  EMCREG_PWM4DIVIDE = 0x61,
+  EMCREG_FAN4CONF1 = 0x62,
+  EMCREG_FAN4CONF2 = 0x63,
+  EMCREG_GAIN4 = 0x65,
+  EMCREG_FAN4SPINUP = 0x66,
+  EMCREG_FAN4MAXSTEP = 0x67,
+  EMCREG_FAN4MINDRIVE = 0x68,
+  EMCREG_FAN4VALIDTACH = 0x69,
+  EMCREG_FAN4FAILLOW = 0x6a,
+  EMCREG_FAN4FAILHIGH = 0x6b,
+  EMCREG_TACH4TARGLOW = 0x6c,
+  EMCREG_TACH4TARGHIGH = 0x6d,
+  EMCREG_TACH4READHIGH = 0x6e,
+  EMCREG_TACH4READLOW = 0x6f,
+  EMCREG_FAN5SETTING = 0x70,
+  EMCREG_PWM5DIVIDE = 0x71,
+  EMCREG_FAN5CONF1 = 0x72,
+  EMCREG_FAN5CONF2 = 0x73,
+  EMCREG_GAIN5 = 0x75,
+  EMCREG_FAN5SPINUP = 0x76,
+  EMCREG_FAN5MAXSTEP = 0x77,
+  EMCREG_FAN5MINDRIVE = 0x78,
+  EMCREG_FAN5VALIDTACH = 0x79,
+  EMCREG_FAN5FAILLOW = 0x7a,
+  EMCREG_FAN5FAILHIGH = 0x7b,
+  EMCREG_TACH5TARGLOW = 0x7c,
+  EMCREG_TACH5TARGHIGH = 0x7d,
+  EMCREG_TACH5READHIGH = 0x7e,
+  EMCREG_TACH5READLOW = 0x7f,
+  EMCREG_SOFTWARELOCK = 0xef,     // when set, some registers become readonly
+  EMCREG_PRODFEATURES = 0xfc,     // only supported on emc230[35]
+  EMCREG_PRODUCT = 0xfd,          // ought be some EMCPRODUCTID_230x value
+  EMCREG_MANUFACTURER = 0xfe,     // ought be EMCMANUFACTURERID
+  EMCREG_REVISION = 0xff,
+} emcreg_e;
+
+// the 13-bit tach count is split across a pair of registers: the high byte
+// holds bits 12..5, and the top five bits of the low byte hold 4..0. the
+// reading has its high byte first (TACHxREADHIGH precedes TACHxREADLOW),
+// while the target has its low byte first.
+static inline unsigned
+tach_from_regs(uint8_t high, uint8_t low){
+  return (high << 5u) | (low >> 3u);
+}
+
+#ifdef EMC230X_DEFINED_OPS
+// execute the chain ops on emc's device handle, subject to its retry policy
+// and circuit breaker, accounting it as an EMC230X_OP_CHAINED moving bytes
+// (excluding address bytes). returns 0 on success, -1 on failure.
+int emc230x_execute_ops(const emc230x* emc, i2c_operation_job_t* ops,
+                        size_t opcount, size_t bytes);
+#endif
+
+#endif
@@ -0,0 +1,186 @@
+#include "emc230x.h"
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#define SAMPLER_DEFAULT_STACK 3072
+#define SAMPLER_DEFAULT_PRIORITY 5
+
+static const char* TAG = "emcsampler";
+
+// each device's samples are published through a pair of buffers. the writer
+// fills the buffer not indicated by seq, then advances seq, so readers
+// always have a complete sample available, and never wait on the writer.
+// 'writing' is advanced before each fill, allowing a reader to detect that
+// the buffer it copied was reused underneath it (i.e. that two or more
+// samples were published during its copy), in which case it retries.
+typedef struct emc230x_publisher {
+  emc230x* emc;
+  atomic_uint_fast32_t seq;     // number of samples published
+  atomic_uint_fast32_t writing; // number of samples begun
+  emc230x_sample buf[2];
+} emc230x_publisher;
+
+struct emc230x_sampler {
+  TaskHandle_t task;
+  SemaphoreHandle_t done;   // given by the task upon exit
+  atomic_bool stopping;
+  emc230x_sampler_config cfg;
+  unsigned count;
+  emc230x_publisher pubs[];
+};
+
+static void
+publish(emc230x_publisher* pub, const emc230x_sample* sample){
+  uint_fast32_t next = atomic_load_explicit(&pub->seq, memory_order_relaxed) + 1;
+  atomic_store_explicit(&pub->writing, next, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&pub->buf[next & 1], sample, sizeof(*sample));
+  atomic_store_explicit(&pub->seq, next, memory_order_release);
+}
+
+// take one sample from the device, returning true if it is stable relative
+// to the previously published sample.
+static bool
+sample_device(emc230x_sampler* s, emc230x_publisher* pub, const emc230x_sample* prev){
+  emc230x_sample sample = { .timestamp_us = 0, };
+  if(emc230x_gettach_all(pub->emc, sample.tach)){
+    return false;
+  }
+  if(emc230x_read_all_status(pub->emc, &sample.status)){
+    return false;
+  }
+  sample.timestamp_us = esp_timer_get_time();
+  sample.fans = emc230x_fancount(pub->emc);
+  for(unsigned i = 0 ; i < sample.fans ; ++i){
+    emc230x_tach_to_rpm(pub->emc, i, sample.tach[i], &sample.rpm[i]);
+  }
+  publish(pub, &sample);
+  if(s->cfg.autorange){
+    emc230x_autorange(pub->emc, sample.tach, NULL);
+  }
+  if(prev->timestamp_us == 0){
+    return false;
+  }
+  if(sample.status.fanstatus || sample.status.stall ||
+      sample.status.spin || sample.status.drivefail){
+    return false;
+  }
+  for(unsigned i = 0 ; i < sample.fans ; ++i){
+    unsigned delta = sample.tach[i] > prev->tach[i] ?
+                      sample.tach[i] - prev->tach[i] : prev->tach[i] - sample.tach[i];
+    if(delta > s->cfg.stable_tach){
+      return false;
+    }
+  }
+  return true;
+}
+
+static void
+sampler_task(void* arg){
+  emc230x_sampler* s = arg;
+  unsigned period = s->cfg.period_ms;
+  while(!atomic_load(&s->stopping)){
+    bool stable = true;
+    for(unsigned i = 0 ; i < s->count ; ++i){
+      emc230x_publisher* pub = &s->pubs[i];
+      emc230x_sample prev = pub->buf[atomic_load(&pub->seq) & 1];
+      if(!sample_device(s, pub, &prev)){
+        stable = false;
+      }
+    }
+    // back off while everything is stable, and return to the base rate as
+    // soon as anything changes.
+    if(!stable){
+      period = s->cfg.period_ms;
+    }else if(period < s->cfg.max_period_ms){
+      period *= 2;
+      if(period > s->cfg.max_period_ms){
+        period = s->cfg.max_period_ms;
+      }
+    }
+    // sleep on our notification, so that emc230x_sampler_stop() can wake us
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(period));
+  }
+  xSemaphoreGive(s->done);
+  vTaskDelete(NULL);
+}
+
+int emc230x_sampler_start(emc230x* const* emcs, unsigned count,
+                          const emc230x_sampler_config* cfg,
+                          emc230x_sampler** sampler){
+  if(count == 0 || cfg->period_ms == 0){
+    ESP_LOGE(TAG, "invalid sampler configuration");
+    return -1;
+  }
+  emc230x_sampler* s = calloc(1, sizeof(*s) + count * sizeof(*s->pubs));
+  if(s == NULL){
+    ESP_LOGE(TAG, "couldn't allocate sampler for %u devices", count);
+    return -1;
+  }
+  s->cfg = *cfg;
+  if(s->cfg.max_period_ms < s->cfg.period_ms){
+    s->cfg.max_period_ms = s->cfg.period_ms;
+  }
+  if(s->cfg.stack_size == 0){
+    s->cfg.stack_size = SAMPLER_DEFAULT_STACK;
+  }
+  if(s->cfg.priority == 0){
+    s->cfg.priority = SAMPLER_DEFAULT_PRIORITY;
+  }
+  s->count = count;
+  for(unsigned i = 0 ; i < count ; ++i){
+    s->pubs[i].emc = emcs[i];
+    atomic_init(&s->pubs[i].seq, 0);
+    atomic_init(&s->pubs[i].writing, 0);
+  }
+  atomic_init(&s->stopping, false);
+  if((s->done = xSemaphoreCreateBinary()) == NULL){
+    ESP_LOGE(TAG, "couldn't create sampler semaphore");
+    free(s);
+    return -1;
+  }
+  if(xTaskCreate(sampler_task, "emc230x", s->cfg.stack_size, s,
+                 s->cfg.priority, &s->task) != pdPASS){
+    ESP_LOGE(TAG, "couldn't create sampler task");
+    vSemaphoreDelete(s->done);
+    free(s);
+    return -1;
+  }
+  *sampler = s;
+  return 0;
+}
+
+int emc230x_sampler_read(const emc230x_sampler* s, unsigned devidx,
+                         emc230x_sample* sample){
+  if(devidx >= s->count){
+    ESP_LOGE(TAG, "invalid device index %u (%u devices)", devidx, s->count);
+    return -1;
+  }
+  emc230x_publisher* pub = (emc230x_publisher*)&s->pubs[devidx];
+  uint_fast32_t seq;
+  do{
+    seq = atomic_load_explicit(&pub->seq, memory_order_acquire);
+    if(seq == 0){
+      return -1; // nothing has yet been published
+    }
+    memcpy(sample, &pub->buf[seq & 1], sizeof(*sample));
+    atomic_thread_fence(memory_order_acquire);
+  }while(atomic_load_explicit(&pub->writing, memory_order_relaxed) - seq > 1);
+  return 0;
+}
+
+void emc230x_sampler_stop(emc230x_sampler* s){
+  if(s){
+    atomic_store(&s->stopping, true);
+    xTaskNotifyGive(s->task);
+    xSemaphoreTake(s->done, portMAX_DELAY);
+    vSemaphoreDelete(s->done);
+    free(s);
+  }
+}
@@ -0,0 +1,222 @@
+#include "emc230x.h"
+#include <esp_log.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#define DEFAULT_EWMA_SHIFT 3
+#define DEFAULT_DECIMATION 8
+#define MAX_EWMA_SHIFT 8
+
+// fixed-point fraction bits of the running mean and sum of squares
+#define Q 8
+
+static const char* TAG = "emctach";
+
+// per-fan state. everything is integer. rather than a running mean, which
+// would stop moving once each sample's share of the difference truncated
+// to zero, the sum is kept, and the mean derived from it (with Q fractional
+// bits, rounded) as needed. m2 (Welford's sum of squared deviations) is
+// kept in Q8. with rpm below 2^16, a deviation is below 2^24 in Q8, so each
+// term of m2 is below 2^40, and m2 cannot overflow within 2^24 samples.
+typedef struct tachfan {
+  uint32_t samples;
+  uint32_t ewma;          // Q8
+  uint64_t sum;           // of the samples, in rpm
+  uint64_t m2;            // Q8
+  uint16_t last;
+  uint16_t min;
+  uint16_t max;
+  // decimated history: each entry is the mean of 'decimation' samples
+  uint32_t decsum;
+  uint16_t deccount;
+  uint8_t head;           // next entry to be written
+  uint8_t used;           // valid entries
+  uint16_t history[EMC230X_TACH_HISTORY];
+} tachfan;
+
+struct emc230x_tachstats {
+  unsigned ewma_shift;
+  unsigned decimation;
+  // odd while the writer is updating; readers retry if it changed (or was
+  // odd) across their copy.
+  atomic_uint seq;
+  tachfan fans[EMC230X_MAXFANS];
+};
+
+static uint32_t
+isqrt64(uint64_t v){
+  uint64_t r = 0;
+  uint64_t bit = 1ull << 62;
+  while(bit > v){
+    bit >>= 2;
+  }
+  while(bit){
+    if(v >= r + bit){
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    }else{
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return r;
+}
+
+int emc230x_tachstats_attach(emc230x* emc, const emc230x_tachstats_config* cfg){
+  if(emc->tachstats){
+    ESP_LOGE(TAG, "tach statistics already attached");
+    return -1;
+  }
+  unsigned shift = cfg && cfg->ewma_shift ? cfg->ewma_shift : DEFAULT_EWMA_SHIFT;
+  unsigned decimation = cfg && cfg->decimation ? cfg->decimation : DEFAULT_DECIMATION;
+  if(shift > MAX_EWMA_SHIFT || decimation > UINT16_MAX){
+    ESP_LOGE(TAG, "invalid tach statistics configuration");
+    return -1;
+  }
+  emc230x_tachstats* ts = calloc(1, sizeof(*ts));
+  if(ts == NULL){
+    ESP_LOGE(TAG, "couldn't allocate tach statistics");
+    return -1;
+  }
+  ts->ewma_shift = shift;
+  ts->decimation = decimation;
+  atomic_init(&ts->seq, 0);
+  emc->tachstats = ts;
+  return 0;
+}
+
+void emc230x_tachstats_detach(emc230x* emc){
+  free(emc->tachstats);
+  emc->tachstats = NULL;
+}
+
+void emc230x_tachstats_reset(emc230x* emc){
+  emc230x_tachstats* ts = emc->tachstats;
+  if(ts){
+    atomic_fetch_add_explicit(&ts->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for(unsigned i = 0 ; i < EMC230X_MAXFANS ; ++i){
+      ts->fans[i] = (tachfan){ .samples = 0, };
+    }
+    atomic_fetch_add_explicit(&ts->seq, 1, memory_order_release);
+  }
+}
+
+// the mean of n samples summing to sum, in Q8, rounded to nearest
+static int32_t
+mean_q(uint64_t sum, uint32_t n){
+  return ((sum << Q) + n / 2) / n;
+}
+
+static void
+feed(tachfan* f, const emc230x_tachstats* ts, uint16_t rpm){
+  const int32_t x = (int32_t)rpm << Q;
+  if(f->samples++ == 0){
+    f->ewma = x;
+    f->sum = rpm;
+    f->min = f->max = rpm;
+  }else{
+    f->ewma += (x - (int32_t)f->ewma) >> ts->ewma_shift;
+    // the rounded means lie on the same side of x, so the term is never
+    // negative
+    const int32_t before = mean_q(f->sum, f->samples - 1);
+    f->sum += rpm;
+    const int32_t after = mean_q(f->sum, f->samples);
+    f->m2 += ((int64_t)(x - before) * (x - after)) >> Q;
+    if(rpm < f->min){
+      f->min = rpm;
+    }
+    if(rpm > f->max){
+      f->max = rpm;
+    }
+  }
+  f->last = rpm;
+  f->decsum += rpm;
+  if(++f->deccount == ts->decimation){
+    f->history[f->head] = f->decsum / f->deccount;
+    f->head = (f->head + 1) % EMC230X_TACH_HISTORY;
+    if(f->used < EMC230X_TACH_HISTORY){
+      ++f->used;
+    }
+    f->decsum = 0;
+    f->deccount = 0;
+  }
+}
+
+void emc230x_tachstats_feed(const emc230x* emc, unsigned fanidx, unsigned tach){
+  emc230x_tachstats* ts = emc->tachstats;
+  unsigned rpm;
+  if(ts == NULL || emc230x_tach_to_rpm(emc, fanidx, tach, &rpm)){
+    return;
+  }
+  if(rpm > UINT16_MAX){
+    rpm = UINT16_MAX;
+  }
+  atomic_fetch_add_explicit(&ts->seq, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  feed(&ts->fans[fanidx], ts, rpm);
+  atomic_fetch_add_explicit(&ts->seq, 1, memory_order_release);
+}
+
+// copy out a consistent view of one fan's state
+static int
+read_fan(const emc230x* emc, unsigned fanidx, tachfan* f){
+  emc230x_tachstats* ts = emc->tachstats;
+  if(ts == NULL){
+    ESP_LOGE(TAG, "no tach statistics attached");
+    return -1;
+  }
+  if(fanidx >= emc230x_fancount(emc)){
+    ESP_LOGE(TAG, "invalid fan index %u", fanidx);
+    return -1;
+  }
+  unsigned seq;
+  do{
+    seq = atomic_load_explicit(&ts->seq, memory_order_acquire);
+    *f = ts->fans[fanidx];
+    atomic_thread_fence(memory_order_acquire);
+  }while((seq & 1) || atomic_load_explicit(&ts->seq, memory_order_relaxed) != seq);
+  return 0;
+}
+
+int emc230x_tachstats_snapshot(const emc230x* emc, unsigned fanidx,
+                               emc230x_tachsnap* snap){
+  tachfan f;
+  if(read_fan(emc, fanidx, &f)){
+    return -1;
+  }
+  *snap = (emc230x_tachsnap){
+    .samples = f.samples,
+    .last_rpm = f.last,
+    .min_rpm = f.min,
+    .max_rpm = f.max,
+    .ewma_rpm = (f.ewma + (1u << (Q - 1))) >> Q,
+  };
+  if(f.samples){
+    snap->mean_rpm = (f.sum + f.samples / 2) / f.samples;
+  }
+  if(f.samples > 1){
+    // m2 / (n - 1) is the variance in Q8; scaling it by another 2^Q puts
+    // its root in Q8.
+    snap->stddev_rpm = (isqrt64((f.m2 / (f.samples - 1)) << Q) + (1u << (Q - 1))) >> Q;
+  }
+  if(f.used > 1){
+    unsigned oldest = (f.head + EMC230X_TACH_HISTORY - f.used) % EMC230X_TACH_HISTORY;
+    unsigned newest = (f.head + EMC230X_TACH_HISTORY - 1) % EMC230X_TACH_HISTORY;
+    snap->trend_rpm = (int)f.history[newest] - (int)f.history[oldest];
+  }
+  return 0;
+}
+
+int emc230x_tachstats_history(const emc230x* emc, unsigned fanidx,
+                              uint16_t rpm[EMC230X_TACH_HISTORY], unsigned* count){
+  tachfan f;
+  if(read_fan(emc, fanidx, &f)){
+    return -1;
+  }
+  for(unsigned i = 0 ; i < f.used ; ++i){
+    rpm[i] = f.history[(f.head + EMC230X_TACH_HISTORY - f.used + i) % EMC230X_TACH_HISTORY];
+  }
+  *count = f.used;
+  return 0;
+}
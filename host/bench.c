@@ -0,0 +1,566 @@
+// report the I2C cost of each component API against the simulated bus:
+// transactions, bytes on the wire, and bus time at 100 and 400 kHz.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <emc230x.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include "emcsim.h"
+
+static void
+report(const char* model, const char* op, int ret, i2c_master_bus_handle_t bus){
+  const emcsim_stats* s = emcsim_stats_get(bus);
+  printf("%-8s %-24s %5u %6u %9.1f %9.1f%s\n", model, op, s->transactions,
+         s->bytes, emcsim_bus_us(s, 100000), emcsim_bus_us(s, 400000),
+         ret ? "  FAILED" : s->lockedwrites ? "  LOCKED" : "");
+}
+
+#define BENCH(op, call) do{ \
+  emcsim_stats_reset(bus); \
+  int r_ = (call); \
+  report(name, (op), r_, bus); \
+}while(0)
+
+static int
+bench_model(const char* name, emc230x_model model, uint8_t productid){
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  if(bus == NULL || emcsim_add(bus, productid, 0x2f) == NULL){
+    fprintf(stderr, "couldn't create simulated %s\n", name);
+    return -1;
+  }
+  emc230x emc;
+  BENCH("detect", emc230x_detect(bus, model, &emc));
+  const unsigned fans = emc230x_fancount(&emc);
+  const unsigned f = fans - 1; // exercise the last fan's register block
+  unsigned tach[EMC230X_MAXFANS];
+  uint8_t pwm[EMC230X_MAXFANS] = { 0x80, 0x80, 0x80, 0x80, 0x80, };
+  unsigned rpm;
+  uint8_t u8;
+  emc230x_status status;
+  emc230x_fsc_options fsc = {
+    .update = EMC230X_UPDATE_400MS,
+    .gainp = EMC230X_GAIN_4X,
+    .gaini = EMC230X_GAIN_4X,
+    .gaind = EMC230X_GAIN_4X,
+    .derivative = EMC230X_DERIVATIVE_BOTH,
+    .errrange = EMC230X_ERRRANGE_50RPM,
+  };
+  emc230x_ramp_options ramp = {
+    .enabled = true,
+    .maxstep = 8,
+    .update = EMC230X_UPDATE_100MS,
+  };
+  emc230x_spinup_options spinup = {
+    .level = EMC230X_SPINLEVEL_50PCT,
+    .time = EMC230X_SPINTIME_1S,
+    .nokick = true,
+    .drivefailcnt = EMC230X_DRIVEFAIL_32,
+  };
+  BENCH("resync", emc230x_resync(&emc));
+  BENCH("setpwm", emc230x_setpwm(&emc, f, 0x80));
+  // repeat tach reads within the update period are served from the cache,
+  // so force the first of them to the bus
+  BENCH("gettach", emc230x_gettach_opt(&emc, f, true, tach));
+  BENCH("gettach (cached)", emc230x_gettach(&emc, f, tach));
+  // the rpm conversion is local, so a fresh read plus conversion is what
+  // emc230x_gettach_rpm() costs outside the cache
+  BENCH("gettach_rpm", emc230x_gettach_opt(&emc, f, true, tach) ||
+                       emc230x_tach_to_rpm(&emc, f, tach[0], &rpm));
+  BENCH("gettach_all", emc230x_gettach_all_opt(&emc, true, tach));
+  BENCH("setpwm_all", emc230x_setpwm_all(&emc, pwm, (1u << fans) - 1));
+  BENCH("read_fanstatus", emc230x_read_fanstatus(&emc, &u8));
+  BENCH("read_fanstallstatus", emc230x_read_fanstallstatus(&emc, &u8));
+  BENCH("read_fanspinstatus", emc230x_read_fanspinstatus(&emc, &u8));
+  BENCH("read_fandrivefail", emc230x_read_fandrivefail(&emc, &u8));
+  BENCH("read_all_status", emc230x_read_all_status(&emc, &status));
+  BENCH("set_clockoutput", emc230x_set_clockoutput(&emc));
+  BENCH("set_clockinput", emc230x_set_clockinput(&emc));
+  BENCH("set_clocklocal", emc230x_set_clocklocal(&emc));
+  BENCH("set_alertmask", emc230x_set_alertmask(&emc, false));
+  BENCH("set_watchdog", emc230x_set_watchdog(&emc, false));
+  BENCH("set_interrupt", emc230x_set_interrupt(&emc, f, true));
+  BENCH("set_pwmpolarity", emc230x_set_pwmpolarity(&emc, f, false));
+  BENCH("set_pwmoutput", emc230x_set_pwmoutput(&emc, f, true));
+  BENCH("set_pwmbasefreq", emc230x_set_pwmbasefreq(&emc, f, EMC230X_BASE_FREQ_26000));
+  BENCH("set_tach_config", emc230x_set_tach_config(&emc, f, 5, EMC230X_RANGE_1000RPM));
+  BENCH("set_fsc_options", emc230x_set_fsc_options(&emc, f, &fsc));
+  BENCH("set_ramp", emc230x_set_ramp(&emc, f, &ramp));
+  BENCH("set_spinup", emc230x_set_spinup(&emc, f, &spinup));
+  BENCH("set_mindrive", emc230x_set_mindrive(&emc, f, 0x40));
+  BENCH("set_target_rpm", emc230x_set_target_rpm(&emc, f, 2000));
+  BENCH("enable_fsc", emc230x_enable_fsc(&emc, f, false));
+  // every per-fan setter for every fan, as one configuration batch
+  emcsim_stats_reset(bus);
+  int r = emc230x_config_begin(&emc);
+  for(unsigned i = 0 ; i < fans ; ++i){
+    r |= emc230x_set_interrupt(&emc, i, true);
+    r |= emc230x_set_pwmpolarity(&emc, i, false);
+    r |= emc230x_set_pwmoutput(&emc, i, true);
+    r |= emc230x_set_pwmbasefreq(&emc, i, EMC230X_BASE_FREQ_26000);
+    r |= emc230x_set_fsc_options(&emc, i, &fsc);
+  }
+  r |= emc230x_config_commit(&emc);
+  report(name, "config batch (all fans)", r, bus);
+  emc230x_destroy(&emc);
+  const emc230x_options fast = {
+    .scl_speed_hz = 400000,
+    .skip_probe = true,
+  };
+  BENCH("detect_opts (fast)", emc230x_detect_opts(bus, model, 0, &fast, &emc));
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// discover three devices among the six candidate addresses
+static int
+bench_scan(void){
+  const char* name = "mixed";
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  if(bus == NULL || emcsim_add(bus, 0x36, 0x2e) == NULL ||
+      emcsim_add(bus, 0x34, 0x2c) == NULL || emcsim_add(bus, 0x35, 0x4d) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emc230x emcs[6];
+  unsigned found;
+  BENCH("scan", emc230x_scan(bus, emcs, sizeof(emcs) / sizeof(*emcs), &found) || found != 3);
+  for(unsigned i = 0 ; i < found ; ++i){
+    emc230x_destroy(&emcs[i]);
+  }
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// drive all fans of an EMC2305 from a slowly rising, noisy temperature for
+// 200 ticks. only changed outputs ought be written.
+static int
+bench_curve(void){
+  const char* name = "EMC2305";
+  static const emc230x_curve_point pts[] = {
+    { 30, 0x40, }, { 50, 0x80, }, { 70, 0xff, },
+  };
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  if(bus == NULL || emcsim_add(bus, 0x34, 0x2f) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emc230x emc;
+  emc230x_curve curve;
+  emc230x_curves cs;
+  if(emc230x_detect(bus, EMC2305, &emc) ||
+      emc230x_curve_build(&curve, pts, sizeof(pts) / sizeof(*pts))){
+    return -1;
+  }
+  emc230x_curves_init(&cs, &emc);
+  for(unsigned i = 0 ; i < emc230x_fancount(&emc) ; ++i){
+    if(emc230x_curves_assign(&cs, i, &curve, 3)){
+      return -1;
+    }
+  }
+  emcsim_stats_reset(bus);
+  int r = 0;
+  for(unsigned tick = 0 ; tick < 200 ; ++tick){
+    int temps[EMC230X_MAXFANS];
+    for(unsigned i = 0 ; i < EMC230X_MAXFANS ; ++i){
+      temps[i] = 25 + tick / 5 + (int)((tick * 7 + i * 3) % 3) - 1;
+    }
+    r |= emc230x_curves_update(&cs, temps, NULL);
+  }
+  report(name, "curve (200 ticks)", r, bus);
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// characterize two dissimilar fans, round-trip the profile through its
+// serialized form, and apply it.
+static int
+bench_profile(void){
+  const char* name = "EMC2302";
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  emcsim_dev* d;
+  if(bus == NULL || (d = emcsim_add(bus, 0x36, 0x2f)) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emcsim_set_fan(d, 0, 3000, 0x30);
+  emcsim_set_fan(d, 1, 7200, 0x58);
+  emc230x emc;
+  if(emc230x_detect(bus, EMC2302_MODEL_2, &emc)){
+    return -1;
+  }
+  emc230x_profile prof, loaded;
+  uint8_t blob[EMC230X_PROFILE_BLOB_MAX];
+  size_t used;
+  BENCH("characterize", emc230x_characterize(&emc, 0x3, 0, &prof));
+  if(emc230x_profile_serialize(&prof, blob, sizeof(blob), &used) ||
+      emc230x_profile_deserialize(&loaded, blob, used) ||
+      memcmp(&prof, &loaded, sizeof(prof))){
+    fprintf(stderr, "profile didn't survive serialization\n");
+    return -1;
+  }
+  BENCH("profile_apply", emc230x_profile_apply(&emc, &loaded));
+  for(unsigned i = 0 ; i < loaded.fans ; ++i){
+    const emc230x_fanprofile* fp = &loaded.fan[i];
+    printf("%-8s fan %u: stall 0x%02x mindrive 0x%02x rpm %u..%u (%zuB blob)\n",
+           name, i, fp->stall_pwm, fp->mindrive, fp->min_rpm, fp->max_rpm, used);
+  }
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// update all fans of three EMC2305s, fan by fan and then as a group.
+static int
+bench_group(void){
+  const char* name = "group";
+  static const uint8_t addrs[] = { 0x2c, 0x2d, 0x2e, };
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  emc230x emcs[3];
+  emc230x* members[3];
+  if(bus == NULL){
+    return -1;
+  }
+  for(unsigned i = 0 ; i < 3 ; ++i){
+    if(emcsim_add(bus, 0x34, addrs[i]) == NULL ||
+        emc230x_detect_at_address(bus, EMC2305, addrs[i], &emcs[i])){
+      fprintf(stderr, "couldn't create simulated bus\n");
+      return -1;
+    }
+    members[i] = &emcs[i];
+  }
+  emc230x_group g;
+  BENCH("group_init", emc230x_group_init(&g, members, 3));
+  uint8_t pwm[EMC230X_GROUP_MAX * EMC230X_MAXFANS];
+  for(unsigned i = 0 ; i < emc230x_group_fancount(&g) ; ++i){
+    pwm[i] = 0x40 + i;
+  }
+  int r = 0;
+  int64_t t0 = esp_timer_get_time();
+  emcsim_stats_reset(bus);
+  for(unsigned i = 0 ; i < 3 ; ++i){
+    for(unsigned f = 0 ; f < emc230x_fancount(&emcs[i]) ; ++f){
+      r |= emc230x_setpwm(&emcs[i], f, pwm[i * 5 + f]);
+    }
+  }
+  report(name, "setpwm x15", r, bus);
+  const int64_t serial = esp_timer_get_time() - t0;
+  int64_t skew;
+  BENCH("group_setpwm", emc230x_group_setpwm(&g, pwm, &skew));
+  printf("%-8s skew bound: %" PRId64 "us fan by fan, %" PRId64 "us grouped (100 kHz)\n",
+         name, serial, skew);
+  for(unsigned i = 0 ; i < 3 ; ++i){
+    emc230x_destroy(&emcs[i]);
+  }
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// three uncoordinated readers, each wanting every tach and the status
+// every 10ms for a simulated second, with and without the cache.
+static int
+bench_cache(void){
+  const char* name = "cache";
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  if(bus == NULL || emcsim_add(bus, 0x34, 0x2f) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emc230x emc;
+  if(emc230x_detect(bus, EMC2305, &emc)){
+    return -1;
+  }
+  for(unsigned fresh = 0 ; fresh < 2 ; ++fresh){
+    unsigned tach[EMC230X_MAXFANS];
+    emc230x_status status;
+    int r = 0;
+    emcsim_stats_reset(bus);
+    for(unsigned tick = 0 ; tick < 100 ; ++tick){
+      for(unsigned reader = 0 ; reader < 3 ; ++reader){
+        r |= emc230x_gettach_all_opt(&emc, fresh, tach);
+        r |= emc230x_read_all_status_opt(&emc, fresh, &status);
+      }
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    report(name, fresh ? "3 readers, fresh" : "3 readers, cached", r, bus);
+  }
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// a control loop reading a tach and writing a PWM setting every 10ms for
+// 50 iterations, on a bus wedged from the outset, under several policies.
+static int
+bench_recovery(void){
+  const char* name = "recovery";
+  static const struct {
+    const char* label;
+    emc230x_retry_policy policy;
+  } cases[] = {
+    { "no policy", { .attempts = 1, }, },
+    { "retry, reset bus", { .attempts = 3, .deadline_ms = 100, .backoff_ms = 1,
+                            .reset_after = 2, }, },
+    { "breaker, no reset", { .attempts = 2, .trip_after = 2, .cooldown_ms = 200, }, },
+  };
+  for(unsigned c = 0 ; c < sizeof(cases) / sizeof(*cases) ; ++c){
+    i2c_master_bus_handle_t bus = emcsim_bus_create();
+    if(bus == NULL || emcsim_add(bus, 0x37, 0x2f) == NULL){
+      fprintf(stderr, "couldn't create simulated bus\n");
+      return -1;
+    }
+    emc230x emc;
+    if(emc230x_detect(bus, EMC2301, &emc) ||
+        emc230x_set_retry_policy(&emc, &cases[c].policy)){
+      return -1;
+    }
+    emcsim_stats_reset(bus);
+    emcsim_wedge(bus, 1000);
+    unsigned ok = 0;
+    const int64_t t0 = esp_timer_get_time();
+    for(unsigned i = 0 ; i < 50 ; ++i){
+      unsigned tach;
+      if(emc230x_gettach_opt(&emc, 0, true, &tach) == 0 &&
+          emc230x_setpwm(&emc, 0, 0x80) == 0){
+        ++ok;
+      }
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    // the loop's own sleeping is excluded
+    const int64_t busy = esp_timer_get_time() - t0 - 50 * 10000;
+    emc230x_health h;
+    emc230x_get_health(&emc, &h);
+    const emcsim_stats* st = emcsim_stats_get(bus);
+    printf("%-8s %-18s %2u/50 ok, %6" PRId64 "us stalled, %3u timeouts, %u resets, "
+           "%3" PRIu32 " fast fails (last error %d)\n", name, cases[c].label, ok,
+           busy, st->timeouts, st->resets, h.fastfails, emc230x_last_error(&emc));
+    emc230x_destroy(&emc);
+    emcsim_bus_destroy(bus);
+  }
+  return 0;
+}
+
+// a representative configuration for every fan of an EMC2305
+static int
+configure_all(emc230x* emc){
+  const emc230x_ramp_options ramp = {
+    .enabled = true,
+    .maxstep = 8,
+    .update = EMC230X_UPDATE_200MS,
+  };
+  const emc230x_spinup_options spin = {
+    .level = EMC230X_SPINLEVEL_45PCT,
+    .time = EMC230X_SPINTIME_1S,
+    .drivefailcnt = EMC230X_DRIVEFAIL_32,
+  };
+  int r = emc230x_set_watchdog(emc, true);
+  for(unsigned i = 0 ; i < emc230x_fancount(emc) ; ++i){
+    r |= emc230x_set_pwmpolarity(emc, i, true);
+    r |= emc230x_set_ramp(emc, i, &ramp);
+    r |= emc230x_set_spinup(emc, i, &spin);
+    r |= emc230x_set_mindrive(emc, i, 0x30);
+    r |= emc230x_set_min_rpm(emc, i, 600);
+    r |= emc230x_setpwm(emc, i, 0x90 + i);
+  }
+  return r;
+}
+
+// recover from a device reset by replaying the setters, and then via
+// emc230x_restore().
+static int
+bench_restore(void){
+  const char* name = "restore";
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  emcsim_dev* d;
+  if(bus == NULL || (d = emcsim_add(bus, 0x34, 0x2f)) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emc230x emc;
+  emc230x_regsnap snap, after;
+  unsigned n;
+  if(emc230x_detect(bus, EMC2305, &emc) || configure_all(&emc)){
+    return -1;
+  }
+  BENCH("snapshot", emc230x_snapshot(&emc, &snap));
+  emcsim_reset(d);
+  BENCH("replay setters", configure_all(&emc));
+  emcsim_reset(d);
+  BENCH("restore", emc230x_restore(&emc, &snap, &n));
+  if(emc230x_snapshot(&emc, &after) || memcmp(&snap, &after, sizeof(snap))){
+    fprintf(stderr, "restore didn't reproduce the snapshot\n");
+    return -1;
+  }
+  printf("%-8s rewrote %u registers\n", name, n);
+  BENCH("restore (no reset)", emc230x_restore(&emc, &snap, &n));
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// slow a fan through a wide range of speeds, letting auto-ranging settle
+// at each, and show the counts it lands upon against the default scale.
+static int
+bench_autorange(void){
+  const char* name = "autorng";
+  static const uint8_t pwms[] = { 0xff, 0x80, 0x40, 0x20, 0x10, };
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  emcsim_dev* d;
+  if(bus == NULL || (d = emcsim_add(bus, 0x37, 0x2f)) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emcsim_set_fan(d, 0, 12000, 0x08);
+  emc230x emc;
+  if(emc230x_detect(bus, EMC2301, &emc)){
+    return -1;
+  }
+  BENCH("set_autorange", emc230x_set_autorange(&emc, 0x1));
+  for(unsigned i = 0 ; i < sizeof(pwms) ; ++i){
+    unsigned tach[EMC230X_MAXFANS];
+    unsigned changed, rpm, steps = 0;
+    if(emc230x_setpwm(&emc, 0, pwms[i])){
+      return -1;
+    }
+    vTaskDelay(pdMS_TO_TICKS(1000)); // let the fan settle
+    do{
+      if(emc230x_gettach_all(&emc, tach) ||
+          emc230x_autorange(&emc, tach, &changed)){
+        return -1;
+      }
+      steps += !!changed;
+    }while(changed);
+    emc230x_tach_to_rpm(&emc, 0, tach[0], &rpm);
+    const unsigned deflt = 8u * 60u * 32768u / (2 * rpm);
+    printf("%-8s pwm 0x%02x: %5u rpm, count 0x%04x (default 0x%04x) after %u steps\n",
+           name, pwms[i], rpm, tach[0], deflt > 0x1fff ? 0x1fff : deflt, steps);
+  }
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// the synchronous and async APIs sharing a bus in asynchronous mode. the
+// synchronous API waits for each completion, and so costs what it would on
+// a synchronous bus; readings from both must agree.
+static int
+bench_async(void){
+  const char* name = "async";
+  i2c_master_bus_handle_t bus = emcsim_bus_create_async();
+  emcsim_dev* d;
+  if(bus == NULL || (d = emcsim_add(bus, 0x34, 0x2f)) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emcsim_set_fan(d, 2, 4000, 0x10);
+  const emc230x_options opts = {
+    .async_bus = true,
+  };
+  emc230x emc;
+  BENCH("detect_opts", emc230x_detect_opts(bus, EMC2305, 0, &opts, &emc));
+  unsigned tach;
+  BENCH("setpwm", emc230x_setpwm(&emc, 2, 0x80));
+  vTaskDelay(pdMS_TO_TICKS(1000)); // let the fan settle
+  BENCH("gettach", emc230x_gettach_opt(&emc, 2, true, &tach));
+  emc230x_async* a;
+  if(emc230x_async_start(&emc, 4, &a)){
+    return -1;
+  }
+  emc230x_async_result res;
+  BENCH("async_gettach", emc230x_async_gettach(a, 2, NULL, NULL));
+  int r = emc230x_async_poll(a, &res, 100);
+  printf("%-8s tach 0x%04x synchronous, 0x%04x async%s\n", name, tach, res.tach,
+         r || !res.ok || res.tach != tach ? "  FAILED" : "");
+  r |= emc230x_async_stop(a, 100);
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return r || !res.ok || res.tach != tach ? -1 : 0;
+}
+
+// the driver's own view of a polling workload, via emc230x_get_stats().
+// latencies are measured against the simulated clock, and so are pure
+// bus time.
+static int
+bench_stats(void){
+  static const char* const opnames[EMC230X_OP_COUNT] = {
+    "read", "write", "chained",
+  };
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  if(bus == NULL || emcsim_add(bus, 0x34, 0x2f) == NULL){
+    fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  emc230x emc;
+  if(emc230x_detect(bus, EMC2305, &emc)){
+    return -1;
+  }
+  emc230x_reset_stats(&emc);
+  if(emc230x_tachstats_attach(&emc, NULL)){
+    return -1;
+  }
+  unsigned tach[EMC230X_MAXFANS];
+  emc230x_status status;
+  for(unsigned i = 0 ; i < 100 ; ++i){
+    emc230x_gettach_all_opt(&emc, true, tach);
+    emc230x_read_all_status(&emc, &status);
+    emc230x_setpwm(&emc, i % 5, i);
+  }
+  emc230x_stats st;
+  if(emc230x_get_stats(&emc, &st)){
+    return -1;
+  }
+  printf("\n%-8s %5s %6s %6s %7s %7s %7s\n", "op", "xact", "bytes",
+         "errors", "min_us", "mean_us", "max_us");
+  for(unsigned i = 0 ; i < EMC230X_OP_COUNT ; ++i){
+    const emc230x_opstats* os = &st.ops[i];
+    printf("%-8s %5u %6u %6u %7u %7u %7u\n", opnames[i], os->transactions,
+           os->bytes, os->errors, os->min_us,
+           os->transactions ? (unsigned)(os->total_us / os->transactions) : 0,
+           os->max_us);
+  }
+  // fan i was stepped through PWM settings i, i + 5, ..., so its rpm
+  // ought ramp up steadily.
+  printf("\n%-8s %7s %5s %5s %5s %5s %6s %5s\n", "fan", "samples", "min",
+         "max", "ewma", "mean", "stddev", "trend");
+  for(unsigned i = 0 ; i < emc230x_fancount(&emc) ; ++i){
+    emc230x_tachsnap snap;
+    if(emc230x_tachstats_snapshot(&emc, i, &snap)){
+      return -1;
+    }
+    printf("%-8u %7" PRIu32 " %5u %5u %5u %5u %6u %5" PRId32 "\n", i, snap.samples,
+           snap.min_rpm, snap.max_rpm, snap.ewma_rpm, snap.mean_rpm,
+           snap.stddev_rpm, snap.trend_rpm);
+  }
+  emc230x_destroy(&emc);
+  emcsim_bus_destroy(bus);
+  return 0;
+}
+
+// in bench_cxx.cpp
+int bench_cxx(void);
+
+int main(void){
+  printf("%-8s %-24s %5s %6s %9s %9s\n", "model", "operation", "xact",
+         "bytes", "us@100k", "us@400k");
+  int r = 0;
+  r |= bench_model("EMC2301", EMC2301, 0x37);
+  r |= bench_model("EMC2302", EMC2302_MODEL_2, 0x36);
+  r |= bench_model("EMC2303", EMC2303, 0x35);
+  r |= bench_model("EMC2305", EMC2305, 0x34);
+  r |= bench_scan();
+  r |= bench_curve();
+  r |= bench_profile();
+  r |= bench_group();
+  r |= bench_async();
+  r |= bench_cxx();
+  r |= bench_autorange();
+  r |= bench_restore();
+  r |= bench_cache();
+  r |= bench_recovery();
+  r |= bench_stats();
+  return r ? EXIT_FAILURE : EXIT_SUCCESS;
+}
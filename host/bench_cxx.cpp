@@ -0,0 +1,38 @@
+// the C++ layer (emc230x.hpp) against the simulated bus. its compile-time
+// checks are exercised merely by building this; at runtime, the template
+// and C paths must agree.
+
+#include <cstdio>
+#include <array>
+#include <emc230x.hpp>
+#include "emcsim.h"
+
+// an out-of-range index is refused at runtime, just as (given as a
+// template argument) it fails to compile.
+static_assert(emc::Device<EMC2301>::fans == 1);
+static_assert(!emc::Fan<EMC2301>::check(1, nullptr));
+
+extern "C" int bench_cxx(void){
+  const char* name = "c++";
+  i2c_master_bus_handle_t bus = emcsim_bus_create();
+  if(bus == nullptr || emcsim_add(bus, 0x34, 0x2f) == nullptr){
+    std::fprintf(stderr, "couldn't create simulated bus\n");
+    return -1;
+  }
+  int r;
+  {
+    emc::Device<EMC2305> dev;
+    constexpr unsigned last = emc::Device<EMC2305>::fans - 1;
+    unsigned tach = 0, ctach = 0;
+    std::array<unsigned, emc::Device<EMC2305>::fans> all{};
+    r = dev.detect(bus) || dev.setpwm<last>(0x80) ||
+        dev.gettach<last>(tach, true) || dev.gettach_all(all, true) ||
+        emc230x_gettach_opt(dev.get(), last, true, &ctach);
+    const bool ok = !r && tach == ctach && all[last] == ctach;
+    std::printf("%-8s tach 0x%04x via Device<EMC2305>, 0x%04x via C%s\n",
+                name, tach, ctach, ok ? "" : "  FAILED");
+    r = ok ? 0 : -1;
+  }
+  emcsim_bus_destroy(bus);
+  return r;
+}
@@ -0,0 +1,779 @@
+#include "emcsim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <driver/gpio.h>
+
+#define SIM_MAXDEVS 8
+#define SIM_MAXFANS 5
+#define TACH_MAX 0x1fffu
+
+// register addresses, per the EMC2301/2/3/5 datasheet
+#define REG_CONFIGURATION 0x20
+#define REG_FANSTATUS     0x24
+#define REG_STALLSTATUS   0x25
+#define REG_SPINSTATUS    0x26
+#define REG_DRIVESTATUS   0x27
+#define REG_FANINTR       0x29
+#define REG_PWMPOLARITY   0x2a
+#define REG_PWMOUTPUT     0x2b
+#define REG_PWMBASE45     0x2c
+#define REG_PWMBASE123    0x2d
+#define REG_FAN1BASE      0x30  // fan n's block begins at 0x30 + 16 * n
+#define REG_SOFTWARELOCK  0xef
+#define REG_PRODFEATURES  0xfc
+#define REG_PRODUCT       0xfd
+#define REG_MANUFACTURER  0xfe
+#define REG_REVISION      0xff
+
+// offsets within a fan's block
+#define FAN_SETTING   0x0
+#define FAN_DIVIDE    0x1
+#define FAN_CONF1     0x2
+#define FAN_CONF2     0x3
+#define FAN_GAIN      0x5
+#define FAN_SPINUP    0x6
+#define FAN_MAXSTEP   0x7
+#define FAN_MINDRIVE  0x8
+#define FAN_VALIDTACH 0x9
+#define FAN_FAILLOW   0xa
+#define FAN_FAILHIGH  0xb
+#define FAN_TARGLOW   0xc
+#define FAN_TARGHIGH  0xd
+#define FAN_READHIGH  0xe   // the reading is high byte first, unlike the target
+#define FAN_READLOW   0xf
+
+typedef struct simfan {
+  unsigned maxrpm;
+  uint8_t stallpwm;
+  bool stall, spin, drivefail;  // active fault conditions
+} simfan;
+
+struct emcsim_dev {
+  uint8_t address;
+  uint8_t productid;
+  unsigned fans;
+  uint8_t regs[256];
+  uint8_t ptr;                  // register pointer, auto-incremented
+  uint8_t stalllatch, spinlatch, drivelatch;
+  bool watch;
+  simfan fan[SIM_MAXFANS];
+};
+
+struct i2c_master_bus_t {
+  emcsim_dev* devs[SIM_MAXDEVS];
+  unsigned ndevs;
+  unsigned wedged;      // transactions yet to time out, see emcsim_wedge()
+  bool async;           // see emcsim_bus_create_async()
+  emcsim_stats stats;
+};
+
+struct i2c_master_dev_t {
+  struct i2c_master_bus_t* bus;
+  uint16_t address;
+  uint32_t scl_speed_hz;
+  i2c_master_event_callbacks_t cbs;
+  void* cbarg;
+};
+
+const char* esp_err_to_name(esp_err_t code){
+  switch(code){
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+  }
+  return "UNKNOWN ERROR";
+}
+
+// registers only writable while the software lock is disengaged. the
+// component toggles the lock around such writes, and the model honors that.
+static bool
+locked_register(uint8_t reg){
+  if(reg == REG_CONFIGURATION || (reg >= REG_PWMPOLARITY && reg <= REG_PWMBASE123)){
+    return true;
+  }
+  if(reg >= REG_FAN1BASE && reg < REG_FAN1BASE + 16 * SIM_MAXFANS){
+    switch(reg & 0xf){
+      case FAN_CONF2: case FAN_GAIN: case FAN_SPINUP: case FAN_MAXSTEP:
+      case FAN_MINDRIVE: case FAN_VALIDTACH: case FAN_FAILLOW: case FAN_FAILHIGH:
+        return true;
+    }
+  }
+  return false;
+}
+
+static bool
+readonly_register(uint8_t reg){
+  if(reg >= REG_FANSTATUS && reg <= REG_DRIVESTATUS){
+    return true;
+  }
+  if(reg >= REG_FAN1BASE && reg < REG_FAN1BASE + 16 * SIM_MAXFANS){
+    unsigned off = reg & 0xf;
+    return off == FAN_READHIGH || off == FAN_READLOW;
+  }
+  return reg >= REG_PRODFEATURES;
+}
+
+// returns the index of the fan whose block contains reg, or -1 if reg is
+// not a fan register. fans beyond the model's count are not present.
+static int
+fan_of(uint8_t reg){
+  if(reg < REG_FAN1BASE || reg >= REG_FAN1BASE + 16 * SIM_MAXFANS){
+    return -1;
+  }
+  return (reg - REG_FAN1BASE) / 16;
+}
+
+void emcsim_reset(emcsim_dev* d){
+  memset(d->regs, 0, sizeof(d->regs));
+  d->regs[REG_CONFIGURATION] = 0x40;
+  for(unsigned i = 0 ; i < d->fans ; ++i){
+    uint8_t* f = &d->regs[REG_FAN1BASE + 16 * i];
+    f[FAN_SETTING] = 0x00;
+    f[FAN_DIVIDE] = 0x01;
+    f[FAN_CONF1] = 0x2b;
+    f[FAN_CONF2] = 0x28;
+    f[FAN_GAIN] = 0x2a;
+    f[FAN_SPINUP] = 0x19;
+    f[FAN_MAXSTEP] = 0x10;
+    f[FAN_MINDRIVE] = 0x66;
+    f[FAN_VALIDTACH] = 0xf5;
+    f[FAN_FAILLOW] = 0xf8;
+    f[FAN_FAILHIGH] = 0xff;
+    f[FAN_TARGLOW] = 0xf8;
+    f[FAN_TARGHIGH] = 0xff;
+  }
+  d->regs[REG_PRODFEATURES] = d->address == 0x2f ? 0x0d : 0x00;
+  d->regs[REG_PRODUCT] = d->productid;
+  d->regs[REG_MANUFACTURER] = 0x5d;
+  d->regs[REG_REVISION] = 0x80;
+  d->stalllatch = d->spinlatch = d->drivelatch = 0;
+  d->watch = false;
+  d->ptr = 0;
+}
+
+// compute the tach count for a fan from its model and configuration.
+static unsigned
+fan_tach(const emcsim_dev* d, unsigned fanidx){
+  const uint8_t* f = &d->regs[REG_FAN1BASE + 16 * fanidx];
+  if(f[FAN_CONF1] & 0x80){ // FSC holds the fan at its target
+    return (f[FAN_TARGHIGH] << 5u) | (f[FAN_TARGLOW] >> 3u);
+  }
+  const simfan* fan = &d->fan[fanidx];
+  const uint8_t setting = f[FAN_SETTING];
+  if(fan->stall || setting < fan->stallpwm || setting == 0){
+    return TACH_MAX;
+  }
+  const unsigned rpm = fan->maxrpm * setting / 255;
+  if(rpm == 0){
+    return TACH_MAX;
+  }
+  const unsigned edges = 3 + 2 * ((f[FAN_CONF1] >> 3u) & 0x3u);
+  const unsigned mult = 1u << ((f[FAN_CONF1] >> 5u) & 0x3u);
+  const unsigned count = (edges - 1) * mult * 60u * 32768u / (2 * rpm);
+  return count > TACH_MAX ? TACH_MAX : count;
+}
+
+static uint8_t
+dev_read(emcsim_dev* d){
+  const uint8_t reg = d->ptr++;
+  const int fan = fan_of(reg);
+  if(fan >= (int)d->fans){
+    return 0;
+  }
+  if(fan >= 0){
+    const unsigned off = reg & 0xf;
+    if(off == FAN_READHIGH){
+      return fan_tach(d, fan) >> 5u;
+    }else if(off == FAN_READLOW){
+      return (fan_tach(d, fan) & 0x1fu) << 3u;
+    }
+    return d->regs[reg];
+  }
+  uint8_t v;
+  switch(reg){
+    case REG_FANSTATUS:
+      v = (d->watch ? 0x80 : 0) | (d->drivelatch ? 0x04 : 0) |
+          (d->spinlatch ? 0x02 : 0) | (d->stalllatch ? 0x01 : 0);
+      d->watch = false;
+      return v;
+    // the per-fan status registers clear upon read, unless the condition
+    // is still present.
+    case REG_STALLSTATUS:
+      v = d->stalllatch;
+      d->stalllatch = 0;
+      for(unsigned i = 0 ; i < d->fans ; ++i){
+        d->stalllatch |= d->fan[i].stall << i;
+      }
+      return v;
+    case REG_SPINSTATUS:
+      v = d->spinlatch;
+      d->spinlatch = 0;
+      for(unsigned i = 0 ; i < d->fans ; ++i){
+        d->spinlatch |= d->fan[i].spin << i;
+      }
+      return v;
+    case REG_DRIVESTATUS:
+      v = d->drivelatch;
+      d->drivelatch = 0;
+      for(unsigned i = 0 ; i < d->fans ; ++i){
+        d->drivelatch |= d->fan[i].drivefail << i;
+      }
+      return v;
+  }
+  return d->regs[reg];
+}
+
+static void
+dev_write(struct i2c_master_bus_t* bus, emcsim_dev* d, uint8_t val){
+  const uint8_t reg = d->ptr++;
+  if(fan_of(reg) >= (int)d->fans || readonly_register(reg)){
+    return;
+  }
+  if((d->regs[REG_SOFTWARELOCK] & 0x1) && locked_register(reg)){
+    ++bus->stats.lockedwrites;
+    return;
+  }
+  if(reg == REG_SOFTWARELOCK){
+    val &= 0x1;
+  }
+  d->regs[reg] = val;
+}
+
+// bus transaction state, following the sequence of conditions on the wire
+typedef struct xfer {
+  struct i2c_master_bus_t* bus;
+  emcsim_dev* dev;      // addressed device, or NULL
+  bool expectaddr;      // the next byte written is an address byte
+  bool expectptr;       // the next byte written sets the register pointer
+  uint32_t hz;          // SCL frequency, for advancing the simulated clock
+} xfer;
+
+// simulated time, advanced by the duration of each bus condition, and
+// reported through esp_timer_get_time().
+static int64_t simclock_ns;
+
+// advance the simulated clock by some number of SCL periods
+static void
+xfer_clock(xfer* x, unsigned clocks){
+  simclock_ns += clocks * 1000000000ll / (x->hz ? x->hz : 100000);
+}
+
+static void
+xfer_start(xfer* x){
+  ++x->bus->stats.starts;
+  xfer_clock(x, 1);
+  x->expectaddr = true;
+  x->dev = NULL;
+}
+
+static emcsim_dev*
+bus_lookup(struct i2c_master_bus_t* bus, uint8_t addr){
+  for(unsigned i = 0 ; i < bus->ndevs ; ++i){
+    if(bus->devs[i]->address == addr){
+      return bus->devs[i];
+    }
+  }
+  return NULL;
+}
+
+// returns false on a NACK
+static bool
+xfer_write(xfer* x, const uint8_t* buf, size_t len){
+  for(size_t i = 0 ; i < len ; ++i){
+    ++x->bus->stats.bytes;
+    xfer_clock(x, 9);
+    if(x->expectaddr){
+      x->expectaddr = false;
+      if((x->dev = bus_lookup(x->bus, buf[i] >> 1u)) == NULL){
+        ++x->bus->stats.nacks;
+        return false;
+      }
+      x->expectptr = true;
+    }else if(x->dev == NULL){
+      return false;
+    }else if(x->expectptr){
+      x->expectptr = false;
+      x->dev->ptr = buf[i];
+    }else{
+      dev_write(x->bus, x->dev, buf[i]);
+    }
+  }
+  return true;
+}
+
+static bool
+xfer_read(xfer* x, uint8_t* buf, size_t len){
+  if(x->dev == NULL){
+    return false;
+  }
+  for(size_t i = 0 ; i < len ; ++i){
+    ++x->bus->stats.bytes;
+    xfer_clock(x, 9);
+    buf[i] = dev_read(x->dev);
+  }
+  return true;
+}
+
+static void
+xfer_stop(xfer* x){
+  ++x->bus->stats.transactions;
+  xfer_clock(x, 1);
+}
+
+int64_t esp_timer_get_time(void){
+  return simclock_ns / 1000;
+}
+
+void vTaskDelay(TickType_t ticks){
+  simclock_ns += ticks * 1000000ll;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fxn, const char* name, uint32_t stack,
+                       void* arg, UBaseType_t priority, TaskHandle_t* task){
+  (void)fxn;
+  (void)stack;
+  (void)arg;
+  (void)priority;
+  (void)task;
+  fprintf(stderr, "no scheduler for task %s\n", name);
+  return pdFAIL;
+}
+
+// with no tasks created, these have nothing to act upon
+void vTaskDelete(TaskHandle_t task){
+  (void)task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks){
+  (void)clear;
+  vTaskDelay(ticks);
+  return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task){
+  (void)task;
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken){
+  (void)task;
+  (void)woken;
+}
+
+esp_err_t gpio_config(const gpio_config_t* cfg){
+  (void)cfg;
+  return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags){
+  (void)flags;
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t isr, void* arg){
+  (void)gpio;
+  (void)isr;
+  (void)arg;
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio){
+  (void)gpio;
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio){
+  (void)gpio;
+  return 1;
+}
+
+struct QueueDefinition {
+  unsigned length, itemsize;
+  unsigned head, count;
+  unsigned char items[];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemsize){
+  QueueHandle_t q = calloc(1, sizeof(*q) + length * itemsize);
+  if(q){
+    q->length = length;
+    q->itemsize = itemsize;
+  }
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t q){
+  free(q);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void* item, BaseType_t* woken){
+  if(q->count == q->length){
+    return pdFALSE;
+  }
+  if(q->itemsize){ // semaphores have no items, and pass NULL
+    memcpy(q->items + (q->head + q->count) % q->length * q->itemsize, item, q->itemsize);
+  }
+  ++q->count;
+  if(woken){
+    *woken = pdTRUE;
+  }
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks){
+  if(q->count == q->length){
+    if(ticks != portMAX_DELAY){
+      vTaskDelay(ticks);
+    }
+    return pdFALSE;
+  }
+  return xQueueSendFromISR(q, item, NULL);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks){
+  if(q->count == 0){
+    if(ticks != portMAX_DELAY){
+      vTaskDelay(ticks);
+    }
+    return pdFALSE;
+  }
+  if(q->itemsize){
+    memcpy(item, q->items + q->head * q->itemsize, q->itemsize);
+  }
+  q->head = (q->head + 1) % q->length;
+  --q->count;
+  return pdTRUE;
+}
+
+// a wedged bus times out the transaction, having consumed its full timeout
+static bool
+bus_wedged(struct i2c_master_bus_t* bus, int xfer_timeout_ms){
+  if(bus->wedged == 0){
+    return false;
+  }
+  --bus->wedged;
+  ++bus->stats.timeouts;
+  simclock_ns += xfer_timeout_ms * 1000000ll;
+  return true;
+}
+
+void emcsim_wedge(i2c_master_bus_handle_t bus, unsigned transactions){
+  bus->wedged = transactions;
+}
+
+i2c_master_bus_handle_t emcsim_bus_create(void){
+  return calloc(1, sizeof(struct i2c_master_bus_t));
+}
+
+i2c_master_bus_handle_t emcsim_bus_create_async(void){
+  struct i2c_master_bus_t* bus = emcsim_bus_create();
+  if(bus){
+    bus->async = true;
+  }
+  return bus;
+}
+
+void emcsim_bus_destroy(i2c_master_bus_handle_t bus){
+  if(bus){
+    for(unsigned i = 0 ; i < bus->ndevs ; ++i){
+      free(bus->devs[i]);
+    }
+    free(bus);
+  }
+}
+
+emcsim_dev* emcsim_add(i2c_master_bus_handle_t bus, uint8_t productid, uint8_t address){
+  unsigned fans;
+  switch(productid){
+    case 0x37: fans = 1; break;
+    case 0x36: fans = 2; break;
+    case 0x35: fans = 3; break;
+    case 0x34: fans = 5; break;
+    default: return NULL;
+  }
+  if(bus->ndevs == SIM_MAXDEVS || bus_lookup(bus, address)){
+    return NULL;
+  }
+  emcsim_dev* d = calloc(1, sizeof(*d));
+  if(d == NULL){
+    return NULL;
+  }
+  d->address = address;
+  d->productid = productid;
+  d->fans = fans;
+  for(unsigned i = 0 ; i < SIM_MAXFANS ; ++i){
+    d->fan[i].maxrpm = 5000;
+    d->fan[i].stallpwm = 0x20;
+  }
+  emcsim_reset(d);
+  bus->devs[bus->ndevs++] = d;
+  return d;
+}
+
+void emcsim_set_fan(emcsim_dev* d, unsigned fanidx, unsigned maxrpm, uint8_t stallpwm){
+  if(fanidx < d->fans){
+    d->fan[fanidx].maxrpm = maxrpm;
+    d->fan[fanidx].stallpwm = stallpwm;
+  }
+}
+
+void emcsim_set_fault(emcsim_dev* d, unsigned fanidx, bool stall, bool spin, bool drivefail){
+  if(fanidx < d->fans){
+    simfan* f = &d->fan[fanidx];
+    f->stall = stall;
+    f->spin = spin;
+    f->drivefail = drivefail;
+    d->stalllatch |= stall << fanidx;
+    d->spinlatch |= spin << fanidx;
+    d->drivelatch |= drivefail << fanidx;
+  }
+}
+
+void emcsim_watchdog(emcsim_dev* d){
+  d->watch = true;
+}
+
+uint8_t emcsim_peek(emcsim_dev* d, uint8_t reg){
+  return d->regs[reg];
+}
+
+void emcsim_poke(emcsim_dev* d, uint8_t reg, uint8_t val){
+  d->regs[reg] = val;
+}
+
+const emcsim_stats* emcsim_stats_get(i2c_master_bus_handle_t bus){
+  return &bus->stats;
+}
+
+void emcsim_stats_reset(i2c_master_bus_handle_t bus){
+  memset(&bus->stats, 0, sizeof(bus->stats));
+}
+
+double emcsim_bus_us(const emcsim_stats* stats, unsigned scl_hz){
+  const double clocks = stats->bytes * 9.0 + stats->starts + stats->transactions;
+  return clocks * 1000000.0 / scl_hz;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle,
+                                    const i2c_device_config_t* dev_config,
+                                    i2c_master_dev_handle_t* ret_handle){
+  if(dev_config->dev_addr_length != I2C_ADDR_BIT_LEN_7 || dev_config->device_address > 0x7f){
+    return ESP_ERR_INVALID_ARG;
+  }
+  struct i2c_master_dev_t* dev = calloc(1, sizeof(*dev));
+  if(dev == NULL){
+    return ESP_ERR_NO_MEM;
+  }
+  dev->bus = bus_handle;
+  dev->address = dev_config->device_address;
+  dev->scl_speed_hz = dev_config->scl_speed_hz;
+  *ret_handle = dev;
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle){
+  free(handle);
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t i2c_dev,
+                                             const i2c_master_event_callbacks_t* cbs,
+                                             void* user_data){
+  if(!i2c_dev->bus->async){
+    return ESP_ERR_INVALID_STATE;
+  }
+  i2c_dev->cbs = *cbs;
+  i2c_dev->cbarg = user_data;
+  return ESP_OK;
+}
+
+// on an asynchronous bus, a submission succeeds once the transaction has
+// been queued, and its outcome goes only to the device's callback.
+// transactions are carried out upon submission, so the callback runs before
+// the submission returns.
+static esp_err_t
+complete(i2c_master_dev_handle_t i2c_dev, esp_err_t e){
+  if(!i2c_dev->bus->async){
+    return e;
+  }
+  if(i2c_dev->cbs.on_trans_done){
+    const i2c_master_event_data_t evt = {
+      .event = e == ESP_OK ? I2C_EVENT_DONE :
+               e == ESP_ERR_TIMEOUT ? I2C_EVENT_TIMEOUT : I2C_EVENT_NACK,
+    };
+    i2c_dev->cbs.on_trans_done(i2c_dev, &evt, i2c_dev->cbarg);
+  }
+  return ESP_OK;
+}
+
+// nothing remains in flight once a submission has returned
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus_handle, int timeout_ms){
+  (void)bus_handle;
+  (void)timeout_ms;
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev,
+                              const uint8_t* write_buffer, size_t write_size,
+                              int xfer_timeout_ms){
+  i2c_master_transmit_multi_buffer_info_t info = {
+    .write_buffer = write_buffer,
+    .buffer_size = write_size,
+  };
+  return i2c_master_multi_buffer_transmit(i2c_dev, &info, 1, xfer_timeout_ms);
+}
+
+static esp_err_t
+multi_buffer_transmit(i2c_master_dev_handle_t i2c_dev,
+                      i2c_master_transmit_multi_buffer_info_t* buffer_info_array,
+                      size_t array_size, int xfer_timeout_ms){
+  if(bus_wedged(i2c_dev->bus, xfer_timeout_ms)){
+    return ESP_ERR_TIMEOUT;
+  }
+  xfer x = { .bus = i2c_dev->bus, .hz = i2c_dev->scl_speed_hz, };
+  const uint8_t addr = i2c_dev->address << 1u;
+  bool ok;
+  xfer_start(&x);
+  ok = xfer_write(&x, &addr, 1);
+  for(size_t i = 0 ; ok && i < array_size ; ++i){
+    ok = xfer_write(&x, buffer_info_array[i].write_buffer, buffer_info_array[i].buffer_size);
+  }
+  xfer_stop(&x);
+  return ok ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2c_master_multi_buffer_transmit(i2c_master_dev_handle_t i2c_dev,
+                                           i2c_master_transmit_multi_buffer_info_t* buffer_info_array,
+                                           size_t array_size, int xfer_timeout_ms){
+  return complete(i2c_dev, multi_buffer_transmit(i2c_dev, buffer_info_array,
+                                                 array_size, xfer_timeout_ms));
+}
+
+static esp_err_t
+transmit_receive(i2c_master_dev_handle_t i2c_dev,
+                 const uint8_t* write_buffer, size_t write_size,
+                 uint8_t* read_buffer, size_t read_size,
+                 int xfer_timeout_ms){
+  if(bus_wedged(i2c_dev->bus, xfer_timeout_ms)){
+    return ESP_ERR_TIMEOUT;
+  }
+  xfer x = { .bus = i2c_dev->bus, .hz = i2c_dev->scl_speed_hz, };
+  const uint8_t waddr = i2c_dev->address << 1u;
+  const uint8_t raddr = waddr | 1u;
+  bool ok;
+  xfer_start(&x);
+  ok = xfer_write(&x, &waddr, 1) && xfer_write(&x, write_buffer, write_size);
+  if(ok){
+    xfer_start(&x);
+    ok = xfer_write(&x, &raddr, 1) && xfer_read(&x, read_buffer, read_size);
+  }
+  xfer_stop(&x);
+  return ok ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev,
+                                      const uint8_t* write_buffer, size_t write_size,
+                                      uint8_t* read_buffer, size_t read_size,
+                                      int xfer_timeout_ms){
+  return complete(i2c_dev, transmit_receive(i2c_dev, write_buffer, write_size,
+                                            read_buffer, read_size, xfer_timeout_ms));
+}
+
+static esp_err_t
+receive(i2c_master_dev_handle_t i2c_dev,
+        uint8_t* read_buffer, size_t read_size,
+        int xfer_timeout_ms){
+  if(bus_wedged(i2c_dev->bus, xfer_timeout_ms)){
+    return ESP_ERR_TIMEOUT;
+  }
+  xfer x = { .bus = i2c_dev->bus, .hz = i2c_dev->scl_speed_hz, };
+  const uint8_t raddr = (i2c_dev->address << 1u) | 1u;
+  bool ok;
+  xfer_start(&x);
+  ok = xfer_write(&x, &raddr, 1) && xfer_read(&x, read_buffer, read_size);
+  xfer_stop(&x);
+  return ok ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev,
+                             uint8_t* read_buffer, size_t read_size,
+                             int xfer_timeout_ms){
+  return complete(i2c_dev, receive(i2c_dev, read_buffer, read_size, xfer_timeout_ms));
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address,
+                           int xfer_timeout_ms){
+  (void)xfer_timeout_ms;
+  xfer x = { .bus = bus_handle, };
+  const uint8_t addr = address << 1u;
+  bool ok;
+  xfer_start(&x);
+  ok = xfer_write(&x, &addr, 1);
+  xfer_stop(&x);
+  return ok ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t
+execute_defined_operations(i2c_master_dev_handle_t i2c_dev,
+                           i2c_operation_job_t* i2c_operation,
+                           size_t operation_list_num,
+                           int xfer_timeout_ms){
+  if(bus_wedged(i2c_dev->bus, xfer_timeout_ms)){
+    return ESP_ERR_TIMEOUT;
+  }
+  xfer x = { .bus = i2c_dev->bus, .hz = i2c_dev->scl_speed_hz, };
+  bool ok = true;
+  bool open = false;
+  for(size_t i = 0 ; i < operation_list_num ; ++i){
+    const i2c_operation_job_t* op = &i2c_operation[i];
+    switch(op->command){
+      case I2C_MASTER_CMD_START:
+        xfer_start(&x);
+        open = true;
+        break;
+      case I2C_MASTER_CMD_WRITE:
+        ok = ok && open && xfer_write(&x, op->write.data, op->write.total_bytes);
+        break;
+      case I2C_MASTER_CMD_READ:
+        ok = ok && open && xfer_read(&x, op->read.data, op->read.total_bytes);
+        break;
+      case I2C_MASTER_CMD_STOP:
+        if(open){
+          xfer_stop(&x);
+          open = false;
+        }
+        break;
+    }
+  }
+  if(open){
+    return ESP_ERR_INVALID_STATE;
+  }
+  return ok ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t i2c_master_execute_defined_operations(i2c_master_dev_handle_t i2c_dev,
+                                                i2c_operation_job_t* i2c_operation,
+                                                size_t operation_list_num,
+                                                int xfer_timeout_ms){
+  return complete(i2c_dev, execute_defined_operations(i2c_dev, i2c_operation,
+                                                      operation_list_num, xfer_timeout_ms));
+}
+
+// nine SCL pulses and a STOP free a slave holding SDA
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle){
+  bus_handle->wedged = 0;
+  ++bus_handle->stats.resets;
+  simclock_ns += 10 * 10000ll;
+  return ESP_OK;
+}
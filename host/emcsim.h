@@ -0,0 +1,76 @@
+#ifndef DANKAMONGMEN_EMCSIM
+#define DANKAMONGMEN_EMCSIM
+
+// a simulated I2C bus populated with EMC230x register models, implementing
+// the subset of ESP-IDF's i2c_master API used by the component. all bus
+// traffic is accounted, so that the I2C cost of each API can be measured
+// without hardware.
+
+#include <driver/i2c_master.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct emcsim_dev emcsim_dev;
+
+typedef struct emcsim_stats {
+  unsigned transactions;  // STOP-terminated bus transactions
+  unsigned starts;        // STARTs, including repeated STARTs
+  unsigned bytes;         // bytes on the wire, including address bytes
+  unsigned nacks;         // address NACKs (no device at the address)
+  unsigned lockedwrites;  // writes dropped due to the software lock
+  unsigned timeouts;      // transactions timed out by a wedged bus
+  unsigned resets;        // calls to i2c_master_bus_reset()
+} emcsim_stats;
+
+i2c_master_bus_handle_t emcsim_bus_create(void);
+
+// a bus in asynchronous mode, as if created with a non-zero
+// trans_queue_depth: submissions return upon queueing the transaction,
+// whose outcome goes only to its device's on_trans_done callback.
+i2c_master_bus_handle_t emcsim_bus_create_async(void);
+void emcsim_bus_destroy(i2c_master_bus_handle_t bus);
+
+// add a device with the given product ID (0x37 for the EMC2301, 0x36 for the
+// EMC2302, 0x35 for the EMC2303, or 0x34 for the EMC2305) at the given 7-bit
+// address. returns NULL on error.
+emcsim_dev* emcsim_add(i2c_master_bus_handle_t bus, uint8_t productid, uint8_t address);
+
+// return all registers to their power-on defaults, as after a brownout.
+void emcsim_reset(emcsim_dev* d);
+
+// in direct mode, the fan runs at maxrpm * setting / 255, or stalls if the
+// setting is below stallpwm. with FSC enabled, it runs at its tach target.
+// fans default to 5000 rpm with a stall threshold of 0x20. all fans are
+// two-pole.
+void emcsim_set_fan(emcsim_dev* d, unsigned fanidx, unsigned maxrpm, uint8_t stallpwm);
+
+// assert (true) or clear (false) fault conditions for a fan. an asserted
+// condition latches its status bit, which is only cleared by a read once
+// the condition has been cleared.
+void emcsim_set_fault(emcsim_dev* d, unsigned fanidx, bool stall, bool spin, bool drivefail);
+
+// time out the next transactions on the bus (after their full timeout),
+// as when a slave holds SDA low, until i2c_master_bus_reset() is called.
+void emcsim_wedge(i2c_master_bus_handle_t bus, unsigned transactions);
+
+// latch the watchdog bit of the Fan Status register.
+void emcsim_watchdog(emcsim_dev* d);
+
+// direct register access, bypassing the bus, locks, and accounting.
+uint8_t emcsim_peek(emcsim_dev* d, uint8_t reg);
+void emcsim_poke(emcsim_dev* d, uint8_t reg, uint8_t val);
+
+const emcsim_stats* emcsim_stats_get(i2c_master_bus_handle_t bus);
+void emcsim_stats_reset(i2c_master_bus_handle_t bus);
+
+// bus time in microseconds for the accounted traffic at scl_hz, counting
+// nine clocks (eight bits and an ACK) per byte, plus one per START and STOP.
+double emcsim_bus_us(const emcsim_stats* stats, unsigned scl_hz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef EMCSIM_GPIO
+#define EMCSIM_GPIO
+
+// host stand-in for ESP-IDF's driver/gpio.h. only the parts used by the
+// component are present. there are no pins: every level reads high (an
+// idle, pulled-up ALERT line), and interrupts never fire.
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// in ESP-IDF, esp_attr.h arrives by way of gpio.h
+#define IRAM_ATTR
+
+typedef int gpio_num_t;
+
+typedef enum {
+  GPIO_MODE_INPUT = 1,
+} gpio_mode_t;
+
+typedef enum {
+  GPIO_PULLUP_DISABLE = 0,
+  GPIO_PULLUP_ENABLE = 1,
+} gpio_pullup_t;
+
+typedef enum {
+  GPIO_PULLDOWN_DISABLE = 0,
+  GPIO_PULLDOWN_ENABLE = 1,
+} gpio_pulldown_t;
+
+typedef enum {
+  GPIO_INTR_DISABLE = 0,
+  GPIO_INTR_NEGEDGE = 2,
+} gpio_int_type_t;
+
+typedef struct {
+  uint64_t pin_bit_mask;
+  gpio_mode_t mode;
+  gpio_pullup_t pull_up_en;
+  gpio_pulldown_t pull_down_en;
+  gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+
+esp_err_t gpio_config(const gpio_config_t* cfg);
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t isr, void* arg);
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio);
+int gpio_get_level(gpio_num_t gpio);
+
+#endif
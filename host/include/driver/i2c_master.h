@@ -0,0 +1,112 @@
+#ifndef EMCSIM_I2C_MASTER
+#define EMCSIM_I2C_MASTER
+
+// host stand-in for ESP-IDF's driver/i2c_master.h, implemented against the
+// simulated bus in emcsim.c. only the parts used by the component are
+// present, with their ESP-IDF 5.4 signatures.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct i2c_master_bus_t* i2c_master_bus_handle_t;
+typedef struct i2c_master_dev_t* i2c_master_dev_handle_t;
+
+typedef enum {
+  I2C_ADDR_BIT_LEN_7 = 0,
+  I2C_ADDR_BIT_LEN_10 = 1,
+} i2c_addr_bit_len_t;
+
+typedef enum {
+  I2C_ACK_VAL = 0,
+  I2C_NACK_VAL = 1,
+} i2c_ack_value_t;
+
+typedef struct {
+  i2c_addr_bit_len_t dev_addr_length;
+  uint16_t device_address;
+  uint32_t scl_speed_hz;
+  uint32_t scl_wait_us;
+  struct {
+    uint32_t disable_ack_check: 1;
+  } flags;
+} i2c_device_config_t;
+
+typedef struct {
+  const uint8_t* write_buffer;
+  size_t buffer_size;
+} i2c_master_transmit_multi_buffer_info_t;
+
+typedef enum {
+  I2C_MASTER_CMD_START,
+  I2C_MASTER_CMD_WRITE,
+  I2C_MASTER_CMD_READ,
+  I2C_MASTER_CMD_STOP,
+} i2c_master_command_t;
+
+typedef struct {
+  i2c_master_command_t command;
+  union {
+    struct {
+      bool ack_check;
+      uint8_t* data;
+      size_t total_bytes;
+    } write;
+    struct {
+      i2c_ack_value_t ack_value;
+      uint8_t* data;
+      size_t total_bytes;
+    } read;
+  };
+} i2c_operation_job_t;
+
+typedef enum {
+  I2C_EVENT_ALIVE,
+  I2C_EVENT_DONE,
+  I2C_EVENT_NACK,
+  I2C_EVENT_TIMEOUT,
+} i2c_master_event_t;
+
+typedef struct {
+  i2c_master_event_t event;
+} i2c_master_event_data_t;
+
+typedef bool (*i2c_master_callback_t)(i2c_master_dev_handle_t i2c_dev,
+                                      const i2c_master_event_data_t* evt_data,
+                                      void* arg);
+
+typedef struct {
+  i2c_master_callback_t on_trans_done;
+} i2c_master_event_callbacks_t;
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle,
+                                    const i2c_device_config_t* dev_config,
+                                    i2c_master_dev_handle_t* ret_handle);
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle);
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev,
+                              const uint8_t* write_buffer, size_t write_size,
+                              int xfer_timeout_ms);
+esp_err_t i2c_master_multi_buffer_transmit(i2c_master_dev_handle_t i2c_dev,
+                                           i2c_master_transmit_multi_buffer_info_t* buffer_info_array,
+                                           size_t array_size, int xfer_timeout_ms);
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev,
+                                      const uint8_t* write_buffer, size_t write_size,
+                                      uint8_t* read_buffer, size_t read_size,
+                                      int xfer_timeout_ms);
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev,
+                             uint8_t* read_buffer, size_t read_size,
+                             int xfer_timeout_ms);
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address,
+                           int xfer_timeout_ms);
+esp_err_t i2c_master_execute_defined_operations(i2c_master_dev_handle_t i2c_dev,
+                                                i2c_operation_job_t* i2c_operation,
+                                                size_t operation_list_num,
+                                                int xfer_timeout_ms);
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle);
+esp_err_t i2c_master_register_event_callbacks(i2c_master_dev_handle_t i2c_dev,
+                                             const i2c_master_event_callbacks_t* cbs,
+                                             void* user_data);
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus_handle, int timeout_ms);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef EMCSIM_ESP_IDF_VERSION
+#define EMCSIM_ESP_IDF_VERSION
+
+// host stand-in for ESP-IDF's esp_idf_version.h. the simulator implements
+// the 5.4 i2c_master API; define EMCSIM_LEGACY_IDF to exercise the
+// component's fallbacks for older releases.
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+
+#ifdef EMCSIM_LEGACY_IDF
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 0, 0)
+#else
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 4, 0)
+#endif
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef EMCSIM_ESP_LOG
+#define EMCSIM_ESP_LOG
+
+// host stand-in for ESP-IDF's esp_log.h. errors and warnings go to stderr;
+// everything else is discarded (but still type-checked).
+
+#include <stdio.h>
+#include "esp_err.h"
+
+#define EMCSIM_LOG(tag, lvl, fmt, ...) \
+  fprintf(stderr, lvl " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define EMCSIM_NOLOG(tag, fmt, ...) \
+  do{ if(0){ printf("%s" fmt, tag, ##__VA_ARGS__); } }while(0)
+
+#define ESP_LOGE(tag, fmt, ...) EMCSIM_LOG(tag, "E", fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) EMCSIM_LOG(tag, "W", fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) EMCSIM_NOLOG(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) EMCSIM_NOLOG(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) EMCSIM_NOLOG(tag, fmt, ##__VA_ARGS__)
+
+#endif
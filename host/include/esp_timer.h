@@ -0,0 +1,11 @@
+#ifndef EMCSIM_ESP_TIMER
+#define EMCSIM_ESP_TIMER
+
+// host stand-in for ESP-IDF's esp_timer.h. time is simulated, advancing
+// only with traffic on the simulated bus (see emcsim.h).
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef EMCSIM_FREERTOS
+#define EMCSIM_FREERTOS
+
+// host stand-in for FreeRTOS.h, covering the types and constants used by
+// the component.
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef EMCSIM_FREERTOS_QUEUE
+#define EMCSIM_FREERTOS_QUEUE
+
+// host stand-in for FreeRTOS's queue.h. with only a single task, a receive
+// from an empty queue can only time out, which advances the simulated clock
+// by the timeout.
+
+#include "FreeRTOS.h"
+
+typedef struct QueueDefinition* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemsize);
+void vQueueDelete(QueueHandle_t q);
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks);
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void* item, BaseType_t* woken);
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef EMCSIM_FREERTOS_SEMPHR
+#define EMCSIM_FREERTOS_SEMPHR
+
+// host stand-in for FreeRTOS's semphr.h. as in FreeRTOS, a binary
+// semaphore is a queue of length one with no item storage, and a mutex is
+// one created full. with only a single task, there is no priority
+// inheritance to model.
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary() xQueueCreate(1, 0)
+#define vSemaphoreDelete(s) vQueueDelete(s)
+#define xSemaphoreTake(s, ticks) xQueueReceive((s), NULL, (ticks))
+#define xSemaphoreGive(s) xQueueSend((s), NULL, 0)
+#define xSemaphoreGiveFromISR(s, woken) xQueueSendFromISR((s), NULL, (woken))
+
+static inline SemaphoreHandle_t
+xSemaphoreCreateMutex(void){
+  SemaphoreHandle_t s = xSemaphoreCreateBinary();
+  if(s){
+    xSemaphoreGive(s);
+  }
+  return s;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef EMCSIM_FREERTOS_TASK
+#define EMCSIM_FREERTOS_TASK
+
+// host stand-in for FreeRTOS's task.h. ticks are milliseconds, and delays
+// advance the simulated clock (see emcsim.h) rather than sleeping. there is
+// no scheduler, so task creation always fails; the sampler, alert, and
+// queue modules build, but can't be started.
+
+#include "FreeRTOS.h"
+
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskCreate(TaskFunction_t fxn, const char* name, uint32_t stack,
+                       void* arg, UBaseType_t priority, TaskHandle_t* task);
+void vTaskDelete(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef EMCSIM_SDKCONFIG
+#define EMCSIM_SDKCONFIG
+
+// host stand-in for the sdkconfig.h generated from the component's Kconfig.
+
+#define CONFIG_EMC230X_STATS 1
+#define CONFIG_EMC230X_REGISTER_LOGGING 1
+#define CONFIG_EMC230X_SUPPORT_EMC2301 1
+#define CONFIG_EMC230X_SUPPORT_EMC2302 1
+#define CONFIG_EMC230X_SUPPORT_EMC2303 1
+#define CONFIG_EMC230X_SUPPORT_EMC2305 1
+#define CONFIG_EMC230X_MAX_FANS 5
+
+#endif
@@ -3,14 +3,160 @@
 
 // ESP-IDF component for working with Microchip EMC230x 4-pin fan controllers.
 
+#include "sdkconfig.h"
+#include <esp_idf_version.h>
 #include <driver/i2c_master.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the most fans of a device which can be used. this is 5 (as on the
+// EMC2305) unless reduced via CONFIG_EMC230X_MAX_FANS.
+#ifdef CONFIG_EMC230X_MAX_FANS
+#define EMC230X_MAXFANS CONFIG_EMC230X_MAX_FANS
+#else
+#define EMC230X_MAXFANS 5
+#endif
+
+// shadow copies of the writable configuration registers. the library is
+// the only writer of these registers, so they are read once at detect time
+// and thereafter updated as they're written, allowing setters to skip the
+// read half of a read-modify-write. fanconf1 and fanconf2 are indexed by fan.
+typedef struct emc230x_shadow {
+  uint8_t configuration;
+  uint8_t fanintr;
+  uint8_t pwmpolarity;
+  uint8_t pwmoutput;
+  uint8_t pwmbase45;
+  uint8_t pwmbase123;
+  uint8_t fanconf1[EMC230X_MAXFANS];
+  uint8_t fanconf2[EMC230X_MAXFANS];
+} emc230x_shadow;
+
+// classes of I2C operation, for statistics.
+typedef enum {
+  EMC230X_OP_READ,      // register reads (pointer write, repeated START, read)
+  EMC230X_OP_WRITE,     // register writes
+  EMC230X_OP_CHAINED,   // several accesses chained with repeated STARTs
+  EMC230X_OP_COUNT
+} emc230x_op;
+
+// latency histogram bucket i counts operations completing in less than
+// EMC230X_LATENCY_BUCKET0_US << i microseconds, and not in an earlier
+// bucket. the last bucket counts everything slower.
+#define EMC230X_LATENCY_BUCKETS 8
+#define EMC230X_LATENCY_BUCKET0_US 128u
+
+typedef struct emc230x_opstats {
+  uint32_t transactions;    // including failures
+  uint32_t bytes;           // payload bytes, excluding address bytes
+  uint32_t errors;
+  uint32_t timeouts;        // errors which were ESP_ERR_TIMEOUT
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t total_us;        // mean latency is total_us / transactions
+  uint32_t latency[EMC230X_LATENCY_BUCKETS];
+} emc230x_opstats;
+
+// the number of distinct error codes counted per device. errors with
+// further codes are counted only in othererrors.
+#define EMC230X_STATS_ERRCODES 4
+
+typedef struct emc230x_stats {
+  emc230x_opstats ops[EMC230X_OP_COUNT];
+  struct {
+    esp_err_t code;
+    uint32_t count;
+  } errcodes[EMC230X_STATS_ERRCODES];
+  uint32_t othererrors;
+} emc230x_stats;
+
+// the cause of the most recent failure, see emc230x_last_error().
+typedef enum {
+  EMC230X_ERR_NONE,
+  EMC230X_ERR_INVALID,        // invalid fan index
+  EMC230X_ERR_NACK,           // the device didn't acknowledge
+  EMC230X_ERR_TIMEOUT,        // the transaction timed out (wedged bus?)
+  EMC230X_ERR_BUS,            // some other failure in the I2C driver
+  EMC230X_ERR_UNAVAILABLE,    // the circuit breaker is open; nothing was sent
+} emc230x_error;
+
+// how I2C failures are handled, see emc230x_set_retry_policy().
+typedef struct emc230x_retry_policy {
+  unsigned attempts;          // attempts per transaction (NACKs and timeouts)
+  unsigned deadline_ms;       // no retry starts past this, 0 for no limit
+  unsigned backoff_ms;        // delay before the first retry, doubling after
+  unsigned reset_after;       // consecutive timeouts before a bus reset, 0: never
+  unsigned trip_after;        // consecutive failures opening the breaker, 0: never
+  unsigned cooldown_ms;       // an open breaker fails fast for this long
+} emc230x_retry_policy;
+
+// recovery counters and circuit breaker state, see emc230x_get_health().
+typedef struct emc230x_health {
+  uint32_t retries;           // attempts beyond the first
+  uint32_t busresets;         // bus resets issued
+  uint32_t trips;             // times the breaker opened
+  uint32_t fastfails;         // transactions refused by the open breaker
+  unsigned consecutive;       // failed transactions since the last success
+  unsigned timeouts;          // timed-out attempts since the last reset
+  bool open;                  // the breaker is open
+  int64_t reopen_us;          // when an open breaker next allows an attempt
+} emc230x_health;
+
+// the most writes which can be staged in a single configuration batch.
+// writes to the same register coalesce.
+#define EMC230X_BATCH_MAX 32
+
+struct emc230x_tachstats;
+
+typedef struct emc230x_status {
+  uint8_t fanstatus;  // Fan Status, see emc230x_fsr_bits
+  uint8_t stall;      // Fan Stall Status, LSB is fan 1
+  uint8_t spin;       // Fan Spin Status, LSB is fan 1
+  uint8_t drivefail;  // Fan Drive Fail, LSB is fan 1
+} emc230x_status;
+
+// recent tach and status readings, see emc230x_gettach_opt().
+typedef struct emc230x_readcache {
+  unsigned tachvalid;                   // mask of fans with a cached reading
+  int64_t tach_us[EMC230X_MAXFANS];     // esp_timer_get_time() of each read
+  uint16_t tach[EMC230X_MAXFANS];
+  uint8_t tachconf1[EMC230X_MAXFANS];   // FANxCONF1 as of each read
+  bool statusvalid;
+  int64_t status_us;
+  emc230x_status status;
+} emc230x_readcache;
+
 // consider this struct to be opaque. it ought not be written nor read
 // by application code.
 typedef struct emc230x {
   int productid;
+  i2c_master_bus_handle_t bus;          // bus on which the device was found
   i2c_master_dev_handle_t i2c;
   uint8_t address;
+  uint32_t scl_speed_hz;
+  int timeout_ms;                       // per-transaction timeout
+  emc230x_shadow shadow;
+  uint8_t poles[EMC230X_MAXFANS];       // per-fan poles for rpm conversion
+  // configuration batch state, see emc230x_config_begin()
+  bool batching;
+  bool batchfailed;
+  unsigned batchcount;
+  uint8_t batch[EMC230X_BATCH_MAX][2];  // staged register + value pairs
+  emc230x_shadow batchsaved;            // shadow as of emc230x_config_begin()
+#ifdef CONFIG_EMC230X_STATS
+  emc230x_stats stats;
+#endif
+  struct emc230x_tachstats* tachstats;  // see emc230x_tachstats_attach()
+  unsigned autorange;                   // mask of auto-ranging fans
+  emc230x_readcache cache;
+  emc230x_retry_policy retry;
+  emc230x_health health;
+  emc230x_error lasterr;
+  // completion of our transactions on a bus in asynchronous mode, see
+  // emc230x_options. NULL on a synchronous bus.
+  struct emc230x_xferwait* xferwait;
 } emc230x;
 
 // in addition to the EMC2301, EMC2303, and EMC2305, there are two models of
@@ -39,50 +185,250 @@ int emc230x_detect_at_address(i2c_master_bus_handle_t i2c,
                               emc230x_model model, uint8_t address,
                               emc230x* emc);
 
+// bus parameters for emc230x_detect_opts(). zero-valued members take the
+// defaults used by emc230x_detect().
+typedef struct emc230x_options {
+  uint32_t scl_speed_hz;  // SCL frequency, default 100 kHz (up to 400 kHz)
+  int timeout_ms;         // per-transaction timeout, default 35 ms
+  int probe_timeout_ms;   // timeout for the initial probe, default timeout_ms
+  bool skip_probe;        // don't probe; the ID read will fail if it's absent
+  // enable the device's SMBus timeout, which resets its interface if SCL is
+  // held low for too long. only possible at 100 kHz or less. if false, the
+  // timeout is disabled (the device's default).
+  bool smbus_timeout;
+  // the bus was created with a non-zero trans_queue_depth, as required by
+  // the async API. ESP-IDF's asynchronous mode applies to the whole bus:
+  // every transaction on it returns once queued. the synchronous API then
+  // waits for each of its transactions to complete, one at a time per
+  // handle. a transaction which doesn't complete within twice timeout_ms
+  // resets the bus. the probe is skipped.
+  bool async_bus;
+} emc230x_options;
+
+// detect the specified model at address (zero for the model's default),
+// using the bus parameters in opts. the device's SMBus timeout is set up to
+// agree with opts->smbus_timeout.
+int emc230x_detect_opts(i2c_master_bus_handle_t i2c, emc230x_model model,
+                        uint8_t address, const emc230x_options* opts,
+                        emc230x* emc);
+
+// probe every address at which an EMC230x might live (0x2c, 0x2d, 0x2e,
+// 0x2f, 0x4c, and 0x4d), identifying the model of any device found from its
+// product ID. up to maxemcs devices are initialized, in order of address,
+// into emcs, and their count is written to *found. returns non-zero only
+// on an error other than the absence of devices, in which case any devices
+// already initialized are destroyed, and *found is zero. the bus must not
+// be in asynchronous mode.
+int emc230x_scan(i2c_master_bus_handle_t i2c, emc230x* emcs, unsigned maxemcs,
+                 unsigned* found);
+
+// set the handling of I2C failures. each transaction is attempted up to
+// policy->attempts (at most 16) times, so long as it fails with a NACK or timeout and
+// deadline_ms (measured from the first attempt, and including any
+// backoff) hasn't passed, sleeping backoff_ms before the first retry and
+// doubling it thereafter. after reset_after consecutive timeouts, the bus
+// is reset via i2c_master_bus_reset() (affecting every device on it).
+// after trip_after consecutive transactions fail all their attempts, the
+// circuit breaker opens: for cooldown_ms, transactions fail immediately
+// with EMC230X_ERR_UNAVAILABLE, after which a single attempt is let
+// through, closing the breaker on success or reopening it on failure.
+// NULL restores the default: a single attempt, no bus resets, and no
+// breaker. the policy applies to the synchronous API, and thus to the
+// queue (which uses it) and group bursts (which go out on the first
+// member's handle); only the async API bypasses it.
+int emc230x_set_retry_policy(emc230x* emc, const emc230x_retry_policy* policy);
+
+// when a call returns non-zero due to an I2C failure or an invalid fan
+// index, the cause is recorded here. it is not cleared by success. other
+// argument errors are only logged.
+emc230x_error emc230x_last_error(const emc230x* emc);
+
+// retrieve the recovery counters and breaker state.
+void emc230x_get_health(const emc230x* emc, emc230x_health* health);
+
+// the model of a detected device. the two EMC2302 models are distinguished
+// by address.
+emc230x_model emc230x_getmodel(const emc230x* emc);
+
 // destroy any resources held by emc, including the i2c handle.
 void emc230x_destroy(emc230x* emc);
 
+// the number of fans supported by the detected model.
+unsigned emc230x_fancount(const emc230x* emc);
+
+// reload the shadowed configuration registers from the device. this is only
+// necessary if the device might have been reset (e.g. due to a brownout) or
+// written by something other than this library.
+int emc230x_resync(emc230x* emc);
+
+// copy the I2C statistics accumulated since detection (or the last
+// emc230x_reset_stats()) into stats. returns non-zero unless the component
+// was built with CONFIG_EMC230X_STATS. statistics are updated without
+// synchronization, so counts might be lost if several tasks use a device.
+int emc230x_get_stats(const emc230x* emc, emc230x_stats* stats);
+
+// zero the I2C statistics. a no-op without CONFIG_EMC230X_STATS.
+void emc230x_reset_stats(emc230x* emc);
+
+// open a configuration batch. until emc230x_config_commit() or
+// emc230x_config_abort() is called, writes to software-locked registers by
+// the emc230x_set_*() functions are staged rather than transmitted (PWM
+// settings and reads are unaffected). the commit issues all staged writes
+// within a single unlock/lock bracket. returns non-zero if a batch is
+// already open.
+int emc230x_config_begin(emc230x* emc);
+
+// transmit all writes staged since emc230x_config_begin(). if any staged
+// write failed (e.g. the batch overflowed EMC230X_BATCH_MAX registers),
+// nothing is transmitted and non-zero is returned. if a bus error occurs
+// partway through, non-zero is returned, and the shadowed registers are
+// reloaded from the device. either way, the batch is closed.
+int emc230x_config_commit(emc230x* emc);
+
+// discard all writes staged since emc230x_config_begin(), and close the batch.
+void emc230x_config_abort(emc230x* emc);
+
+// the 0x20..0x7f register space, as captured by emc230x_snapshot(). only
+// the writable registers are meaningful; the status registers and tach
+// readings are not captured.
+#define EMC230X_SNAPSHOT_BASE 0x20
+#define EMC230X_SNAPSHOT_BYTES 0x60
+
+typedef struct emc230x_regsnap {
+  int productid;
+  uint8_t regs[EMC230X_SNAPSHOT_BYTES];   // indexed from EMC230X_SNAPSHOT_BASE
+} emc230x_regsnap;
+
+// capture the writable registers of the device (including fan settings
+// and tach targets) using three block reads.
+int emc230x_snapshot(const emc230x* emc, emc230x_regsnap* snap);
+
+// bring the device back to snap, e.g. after a brownout has reset it to
+// its defaults. the registers are read back (three block reads), and only
+// those differing from snap are rewritten, all within a single unlock/lock
+// bracket. if nothing differs, nothing is written, so this is cheap to
+// call speculatively (or upon EMC230X_FSR_WATCH, which a reset device
+// raises once its poweron watchdog expires). the number of registers
+// rewritten is stored to *rewritten, if not NULL. on success, the shadow
+// reflects snap. fails if a configuration batch is open.
+int emc230x_restore(emc230x* emc, const emc230x_regsnap* snap, unsigned* rewritten);
+
 // use the CLK pin as an push-pull output, allowing multiple devices to sync.
 // this forces use of our internal oscillator as our clock source.
-int emc230x_set_clockoutput(const emc230x* emc);
+int emc230x_set_clockoutput(emc230x* emc);
 
 // use the CLK pin as an input.
-int emc230x_set_clockinput(const emc230x* emc);
+int emc230x_set_clockinput(emc230x* emc);
 
 // use the internal oscillator as our clock, and don't replicate it on the
 // CLK pin. this is the default setting.
-int emc230x_set_clocklocal(const emc230x* emc);
+int emc230x_set_clocklocal(emc230x* emc);
 
 // set the PWM output [0..255] for the specified fan.
 int emc230x_setpwm(const emc230x* emc, unsigned fanidx, uint8_t pwm);
 
+// read back the PWM setting [0..255] of the specified fan. while FSC is
+// enabled, this is the drive chosen by the algorithm.
+int emc230x_getpwm(const emc230x* emc, unsigned fanidx, uint8_t* pwm);
+
 // read the tachometer for the specified fan. returns the direct result read
 // from the register (const number of 32.768 kHz cycles between measurements).
+// the device refreshes the reading once per update period (the UPDATE
+// field of FANxCONF1, 400ms by default), so a reading younger than that is
+// returned from the handle's cache without I2C access. any change to
+// FANxCONF1 through the library invalidates the fan's cached reading.
 int emc230x_gettach(const emc230x* emc, unsigned fanidx, unsigned* tach);
 
-// read the tachometer for the specified fan, and convert it to rpm. assumes a
-// two-pole fan reading five edges.
+// as emc230x_gettach(), but if fresh is true, the device is always read
+// (and the cache updated).
+int emc230x_gettach_opt(const emc230x* emc, unsigned fanidx, bool fresh, unsigned* tach);
+
+// read the tachometer for the specified fan, and convert it to rpm. the
+// conversion uses the fan's pole count (see emc230x_set_fan_poles()) and the
+// edges and range currently configured in FANxCONF1. a stalled or stopped
+// fan reads as zero rpm.
 int emc230x_gettach_rpm(const emc230x* emc, unsigned fanidx, unsigned* rpm);
 
+// convert between tach counts and rpm as emc230x_gettach_rpm() does, without
+// any I2C access. zero rpm corresponds to a tach count of 0x1fff, as does
+// any speed too slow to be represented. only integer arithmetic is used.
+int emc230x_tach_to_rpm(const emc230x* emc, unsigned fanidx, unsigned tach, unsigned* rpm);
+int emc230x_rpm_to_tach(const emc230x* emc, unsigned fanidx, unsigned rpm, unsigned* tach);
+
+// set the number of poles of the specified fan, used for rpm conversions.
+// this is not written to the device. the default is 2.
+int emc230x_set_fan_poles(emc230x* emc, unsigned fanidx, unsigned poles);
+
+// the tach multiplier (RANGE bits of FANxCONF1), named for the minimum
+// measurable rpm (of a two-pole fan reading five edges).
+typedef enum {
+  EMC230X_RANGE_500RPM,     // multiplier 1
+  EMC230X_RANGE_1000RPM,    // multiplier 2, default
+  EMC230X_RANGE_2000RPM,    // multiplier 4
+  EMC230X_RANGE_4000RPM,    // multiplier 8
+} emc230x_range;
+
+// set the number of tach edges sampled per measurement (3, 5, 7, or 9;
+// the default is 5) and the tach range for the specified fan.
+int emc230x_set_tach_config(emc230x* emc, unsigned fanidx, unsigned edges,
+                            emc230x_range range);
+
+// larger tach counts for a given speed mean finer resolution, but slow
+// fans can overflow the 13-bit count. auto-ranging fans have their EDGES
+// and RANGE stepped (by factors of two) so as to keep counts between
+// 0x0c00 and 0x1c00. rpm conversions account for the current scale, and
+// the tach target, valid tach limit, and drive fail band are rescaled
+// with it (in the same unlock/lock bracket as the change). enabled fans
+// are stepped by emc230x_autorange(), which ought be called with fresh
+// readings; a sampler with autorange set does so after each sample. the
+// reading following a change might still reflect the previous scale.
+int emc230x_set_autorange(emc230x* emc, unsigned mask);
+
+// given tach counts just read (after any conversion to rpm), step the
+// scale of any auto-ranging fans outside the window, setting *changed (if
+// not NULL) to the mask of fans which were stepped. does nothing while a
+// configuration batch is open.
+int emc230x_autorange(emc230x* emc, const unsigned tach[EMC230X_MAXFANS],
+                      unsigned* changed);
+
+// read the tachometers of all fans supported by the device into tach,
+// minimizing bus turnaround. only the first N entries are written for a
+// device supporting N fans.
+int emc230x_gettach_all(const emc230x* emc, unsigned tach[EMC230X_MAXFANS]);
+
+// as emc230x_gettach_all(), but if fresh is true, the device is always
+// read. otherwise, the cache is used if every fan's reading is cached.
+int emc230x_gettach_all_opt(const emc230x* emc, bool fresh, unsigned tach[EMC230X_MAXFANS]);
+
+// set the PWM outputs of all fans whose bit is set in mask (LSB is fan 1)
+// to the corresponding entry of pwm, minimizing bus turnaround. bits set in
+// mask beyond the number of supported fans result in an error.
+int emc230x_setpwm_all(const emc230x* emc, const uint8_t pwm[EMC230X_MAXFANS],
+                       unsigned mask);
+
 // by default, the alert pin is masked and will not be asserted. true
 // sets/keeps the mask. false disables it.
-int emc230x_set_alertmask(const emc230x* emc, bool masked);
+int emc230x_set_alertmask(emc230x* emc, bool masked);
+
+// by default, the SMBus timeout is disabled. true enables it, which is
+// only permitted if the device was detected at 100 kHz or less.
+int emc230x_set_timeout(emc230x* emc, bool enabled);
 
 // by default, the watchdog timer only operates at initial poweron. true
 // enables the continuous watchdog. false disables it.
-int emc230x_set_watchdog(const emc230x* emc, bool enabled);
+int emc230x_set_watchdog(emc230x* emc, bool enabled);
 
 // by default, interrupts are disabled for all fans. true enables interrupts
 // for the specified fan. false disables them.
-int emc230x_set_interrupt(const emc230x* emc, unsigned fanidx, bool enabled);
+int emc230x_set_interrupt(emc230x* emc, unsigned fanidx, bool enabled);
 
 // by default, PWM is 100% at 0xff and 0% at 0x0. polarity can be inverted
 // to interpret higher PWM as a lower duty cycle.
-int emc230x_set_pwmpolarity(const emc230x* emc, unsigned fanidx, bool inverted);
+int emc230x_set_pwmpolarity(emc230x* emc, unsigned fanidx, bool inverted);
 
 // by default, PWM is open drain. true sets the specified PWM output to
 // push-pull, false to open drain.
-int emc230x_set_pwmoutput(const emc230x* emc, unsigned fanidx, bool pushpull);
+int emc230x_set_pwmoutput(emc230x* emc, unsigned fanidx, bool pushpull);
 
 typedef enum {
   EMC230X_BASE_FREQ_26000,  // 26.00 kHz, value 00
@@ -93,7 +439,7 @@ typedef enum {
 
 // set the base PWM frequency for the fan. default is EMC230X_BASE_FREQ_26000,
 // which is what you want for PC fans.
-int emc230x_set_pwmbasefreq(const emc230x* emc, unsigned fanidx, emc230x_base_freq freq);
+int emc230x_set_pwmbasefreq(emc230x* emc, unsigned fanidx, emc230x_base_freq freq);
 
 typedef enum {
   EMC230X_FSR_FNSTL = 0x01,   // one or more fans have stalled
@@ -127,4 +473,550 @@ int emc230x_read_fanspinstatus(const emc230x* emc, uint8_t* fss);
 // on the EMC2305.
 int emc230x_read_fandrivefail(const emc230x* emc, uint8_t* fdf);
 
+// read all four status registers in a single transfer. the same clearing
+// semantics apply as to the individual reads above. this always reads the
+// device, but updates the cache used by emc230x_read_all_status_opt().
+int emc230x_read_all_status(const emc230x* emc, emc230x_status* status);
+
+// as emc230x_read_all_status(), but unless fresh is true, a status read
+// within the shortest update period of any fan is returned from the cache.
+// a cached status was cleared upon its original read, and is repeated to
+// every caller within the period; events since then remain latched in the
+// device until a read reaches it.
+int emc230x_read_all_status_opt(const emc230x* emc, bool fresh, emc230x_status* status);
+
+// the EMC230x can run a closed-loop RPM-based Fan Speed Control (FSC)
+// algorithm, driving the PWM output so as to maintain a tach target. while
+// FSC is enabled for a fan, its PWM setting is managed by the device, and
+// emc230x_setpwm() has no effect.
+
+// enable or disable FSC (the EN_ALGO bit of FANxCONF1) for the specified
+// fan. set a target (and possibly the FSC options) before enabling.
+int emc230x_enable_fsc(emc230x* emc, unsigned fanidx, bool enabled);
+
+// set the FSC target for the specified fan in rpm, converting it to a tach
+// count. zero stops the fan.
+int emc230x_set_target_rpm(emc230x* emc, unsigned fanidx, unsigned rpm);
+
+// set the FSC target for the specified fan directly as a 13-bit tach count
+// (number of 32.768 kHz cycles between measurements). 0x1fff stops the fan.
+int emc230x_set_target_tach(emc230x* emc, unsigned fanidx, unsigned tach);
+
+// how often the FSC algorithm updates the drive (UPDATE bits of FANxCONF1).
+typedef enum {
+  EMC230X_UPDATE_100MS,
+  EMC230X_UPDATE_200MS,
+  EMC230X_UPDATE_300MS,
+  EMC230X_UPDATE_400MS,   // default
+  EMC230X_UPDATE_500MS,
+  EMC230X_UPDATE_800MS,
+  EMC230X_UPDATE_1200MS,
+  EMC230X_UPDATE_1600MS,
+} emc230x_update;
+
+// gain multipliers for each term of the FSC PID controller (GAINx).
+typedef enum {
+  EMC230X_GAIN_1X,
+  EMC230X_GAIN_2X,
+  EMC230X_GAIN_4X,      // default
+  EMC230X_GAIN_8X,
+} emc230x_gain;
+
+// derivative options for the FSC controller (DER_OPT bits of FANxCONF2).
+typedef enum {
+  EMC230X_DERIVATIVE_NONE,
+  EMC230X_DERIVATIVE_BASIC,   // difference of the error terms (default)
+  EMC230X_DERIVATIVE_STEP,    // difference of the tach readings
+  EMC230X_DERIVATIVE_BOTH,
+} emc230x_derivative;
+
+// error window within which FSC makes no adjustments (ERR_RNG bits of
+// FANxCONF2).
+typedef enum {
+  EMC230X_ERRRANGE_0RPM,      // default
+  EMC230X_ERRRANGE_50RPM,
+  EMC230X_ERRRANGE_100RPM,
+  EMC230X_ERRRANGE_200RPM,
+} emc230x_errrange;
+
+typedef struct emc230x_fsc_options {
+  emc230x_update update;
+  emc230x_gain gainp;
+  emc230x_gain gaini;
+  emc230x_gain gaind;
+  emc230x_derivative derivative;
+  emc230x_errrange errrange;
+} emc230x_fsc_options;
+
+// configure the FSC algorithm for the specified fan. if no configuration
+// batch is open, one is used internally, so that all settings are applied
+// within a single unlock/lock bracket.
+int emc230x_set_fsc_options(emc230x* emc, unsigned fanidx,
+                            const emc230x_fsc_options* opts);
+
+// outside of FSC, the device can ramp toward a new PWM setting rather than
+// stepping to it: with ramp rate control enabled (EN_RRC of FANxCONF2), the
+// drive moves by at most maxstep each update period (the UPDATE bits of
+// FANxCONF1, shared with FSC, which also limits its steps by maxstep).
+typedef struct emc230x_ramp_options {
+  bool enabled;             // ramp direct PWM settings
+  unsigned maxstep;         // largest change per update period [1..63]
+  emc230x_update update;    // update period
+} emc230x_ramp_options;
+
+// configure ramping for the specified fan. if no configuration batch is
+// open, one is used internally.
+int emc230x_set_ramp(emc230x* emc, unsigned fanidx,
+                     const emc230x_ramp_options* opts);
+
+// drive level (as a fraction of full scale) held while spinning up a fan
+// from a stop (SPIN_LVL bits of FANxSPINUP).
+typedef enum {
+  EMC230X_SPINLEVEL_30PCT,
+  EMC230X_SPINLEVEL_35PCT,
+  EMC230X_SPINLEVEL_40PCT,
+  EMC230X_SPINLEVEL_45PCT,
+  EMC230X_SPINLEVEL_50PCT,
+  EMC230X_SPINLEVEL_55PCT,
+  EMC230X_SPINLEVEL_60PCT,    // default
+  EMC230X_SPINLEVEL_65PCT,
+} emc230x_spinlevel;
+
+// duration of spin-up (SPINUP_TIME bits of FANxSPINUP).
+typedef enum {
+  EMC230X_SPINTIME_250MS,
+  EMC230X_SPINTIME_500MS,     // default
+  EMC230X_SPINTIME_1S,
+  EMC230X_SPINTIME_2S,
+} emc230x_spintime;
+
+// number of update periods for which FSC must fail to reach its target
+// before a drive fail is flagged (DRIVE_FAIL_CNT bits of FANxSPINUP).
+typedef enum {
+  EMC230X_DRIVEFAIL_DISABLED, // default
+  EMC230X_DRIVEFAIL_16,
+  EMC230X_DRIVEFAIL_32,
+  EMC230X_DRIVEFAIL_64,
+} emc230x_drivefailcnt;
+
+typedef struct emc230x_spinup_options {
+  emc230x_spinlevel level;
+  emc230x_spintime time;
+  bool nokick;      // don't drive at 100% for the first quarter of spin-up
+  emc230x_drivefailcnt drivefailcnt;
+} emc230x_spinup_options;
+
+// configure the spin-up profile for the specified fan (FANxSPINUP).
+int emc230x_set_spinup(emc230x* emc, unsigned fanidx,
+                       const emc230x_spinup_options* opts);
+
+// set the minimum drive for the specified fan (FANxMINDRIVE), below which
+// FSC will not drive it. the reset value is 0x66 (40%).
+int emc230x_set_mindrive(emc230x* emc, unsigned fanidx, uint8_t pwm);
+
+// set the lowest speed at which the specified fan's tach is considered
+// valid (FANxVALIDTACH); slower readings flag a stall. the conversion uses
+// the current pole, edge, and range configuration.
+int emc230x_set_min_rpm(emc230x* emc, unsigned fanidx, unsigned rpm);
+
+// set the drive fail band of the specified fan in tach counts
+// (FANxFAILLOW/FAILHIGH). when the drive is at 100% and the tach remains
+// further than this from its target, a drive fail is flagged.
+int emc230x_set_drivefail_band(emc230x* emc, unsigned fanidx, unsigned tach);
+
+// fans can be characterized by sweeping their PWM settings and measuring
+// the resulting speeds. the resulting profile models each fan's PWM-to-rpm
+// response, and can be serialized (e.g. to NVS) and applied at boot to
+// configure stall and drive fail detection without another sweep.
+
+// sweep points are taken at PWM settings 0x00, 0x10, ..., 0xf0, and 0xff.
+#define EMC230X_PROFILE_POINTS 17
+
+typedef struct emc230x_fanprofile {
+  uint8_t stall_pwm;    // lowest setting at which the fan kept turning
+  uint8_t mindrive;     // a sweep point above stall_pwm
+  uint16_t min_rpm;     // speed at mindrive
+  uint16_t max_rpm;     // speed at full drive, 0 if uncharacterized
+  uint16_t rpm[EMC230X_PROFILE_POINTS];
+} emc230x_fanprofile;
+
+typedef struct emc230x_profile {
+  unsigned fans;
+  emc230x_fanprofile fan[EMC230X_MAXFANS];
+} emc230x_profile;
+
+// the largest serialized profile
+#define EMC230X_PROFILE_BLOB_MAX (4 + EMC230X_MAXFANS * (6 + 2 * EMC230X_PROFILE_POINTS))
+
+// characterize the fans in mask, waiting settle_ms (0 for a default of two
+// seconds) at each sweep point, so this takes on the order of half a
+// minute. FSC must be disabled for these fans. their PWM settings are
+// restored afterwards. fans which never turn are left uncharacterized.
+// speeds below the configured range (see emc230x_set_tach_config()) read
+// as stopped, so select a range admitting the fans' slowest speeds.
+int emc230x_characterize(emc230x* emc, unsigned mask, unsigned settle_ms,
+                         emc230x_profile* prof);
+
+// interpolate the expected speed of the specified fan at a PWM setting.
+int emc230x_profile_rpm(const emc230x_profile* prof, unsigned fanidx,
+                        uint8_t pwm, unsigned* rpm);
+
+// configure each characterized fan's minimum drive, minimum valid speed
+// (three quarters of min_rpm), and drive fail band (10% of max_rpm)
+// within a single configuration batch (the caller's, if open).
+int emc230x_profile_apply(emc230x* emc, const emc230x_profile* prof);
+
+// serialize prof into buf, which must have room for 4 + 40 bytes per fan
+// (see EMC230X_PROFILE_BLOB_MAX). *used is set to the length written.
+int emc230x_profile_serialize(const emc230x_profile* prof, uint8_t* buf,
+                              size_t len, size_t* used);
+
+// load a profile from a serialized blob, verifying its checksum.
+int emc230x_profile_deserialize(emc230x_profile* prof, const uint8_t* buf,
+                                size_t len);
+
+// several devices sharing a bus can be driven as a group. the first member
+// provides the clock for the others, so their PWM outputs share a
+// timebase, and the PWM settings of all members' fans are written in one
+// burst: with ESP-IDF 5.4 or later, a single transaction chaining every
+// write with repeated STARTs, from buffers encoded ahead of time.
+#define EMC230X_GROUP_MAX 4
+
+// consider this struct to be opaque.
+typedef struct emc230x_group {
+  emc230x* emcs[EMC230X_GROUP_MAX];
+  unsigned count;
+  unsigned fans;
+  uint8_t wbufs[EMC230X_GROUP_MAX * EMC230X_MAXFANS][3];
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0)
+  i2c_operation_job_t ops[EMC230X_GROUP_MAX * EMC230X_MAXFANS * 2 + 1];
+#endif
+  unsigned opcount;
+} emc230x_group;
+
+// form a group of count devices (which must remain valid for the life of
+// the group), and configure their clocks: emcs[0] outputs its clock on
+// CLK, and the others take their clocks from it.
+int emc230x_group_init(emc230x_group* g, emc230x* const* emcs, unsigned count);
+
+// the number of fans in the group, across all members.
+unsigned emc230x_group_fancount(const emc230x_group* g);
+
+// write the PWM settings of every fan in the group from pwm, which has an
+// entry for each fan, ordered by member and then fan index. if skew_us is
+// not NULL, it is set to the wall-clock duration of the burst (including
+// any retries). this is an upper bound on the skew between the first and
+// last fans' updates, not a measurement of it.
+int emc230x_group_setpwm(emc230x_group* g, const uint8_t* pwm, int64_t* skew_us);
+
+// an optional FreeRTOS task can periodically sample one or more devices,
+// publishing the results such that any number of readers can retrieve the
+// latest sample without I2C access, blocking, or mutexes. while the sampler
+// is running, it owns the (clear-on-read) status registers of its devices.
+typedef struct emc230x_sampler emc230x_sampler;
+
+typedef struct emc230x_sample {
+  int64_t timestamp_us;     // esp_timer_get_time() when the sample completed
+  unsigned fans;            // number of valid entries in tach and rpm
+  unsigned tach[EMC230X_MAXFANS];
+  unsigned rpm[EMC230X_MAXFANS];
+  emc230x_status status;
+} emc230x_sample;
+
+typedef struct emc230x_sampler_config {
+  unsigned period_ms;       // sampling period, must be non-zero
+  // while all tachs remain within stable_tach counts of their previous
+  // sample and no status bits are set, the period doubles after each
+  // sample, up to max_period_ms. it returns to period_ms upon any change.
+  // a max_period_ms no greater than period_ms disables backoff.
+  unsigned max_period_ms;
+  unsigned stable_tach;
+  unsigned stack_size;      // sampler task stack, 0 for a default
+  unsigned priority;        // sampler task priority, 0 for a default
+  bool autorange;           // call emc230x_autorange() after each sample
+} emc230x_sampler_config;
+
+// start sampling the count devices in emcs. the devices must remain valid
+// until emc230x_sampler_stop(). on success, *sampler is set and 0 is returned.
+int emc230x_sampler_start(emc230x* const* emcs, unsigned count,
+                          const emc230x_sampler_config* cfg,
+                          emc230x_sampler** sampler);
+
+// copy the latest sample of device devidx (its index in emcs as passed to
+// emc230x_sampler_start()) into sample. returns non-zero if no sample has
+// yet been taken. safe to call from any task.
+int emc230x_sampler_read(const emc230x_sampler* s, unsigned devidx,
+                         emc230x_sample* sample);
+
+// stop the sampler task, and free the sampler.
+void emc230x_sampler_stop(emc230x_sampler* s);
+
+// the ALERT pin is asserted (pulled low) when an unmasked fault occurs, if
+// the alert mask has been cleared (see emc230x_set_alertmask()) and
+// interrupts are enabled for the fan (see emc230x_set_interrupt()). several
+// devices can share a single open-drain ALERT line. an alert handler
+// installs an ISR on the GPIO connected to ALERT, and defers to a task
+// which reads all the status registers of each device on the line upon
+// each falling edge, invoking registered callbacks for any faults found.
+// while the line remains asserted thereafter (a persistent fault, or one
+// raised during the reads), the task reads them again with a backoff of
+// 10ms, doubling up to 1s, so faults persisting that long are reported
+// about once a second.
+typedef struct emc230x_alert emc230x_alert;
+
+typedef enum {
+  EMC230X_EVENT_STALL = 0x01,       // the fan has stalled
+  EMC230X_EVENT_SPIN = 0x02,        // the fan failed to spin up
+  EMC230X_EVENT_DRIVEFAIL = 0x04,   // the fan can't reach its target
+  EMC230X_EVENT_WATCHDOG = 0x08,    // the watchdog expired (device-wide)
+} emc230x_event_bits;
+
+// device-wide events are reported with this fan index
+#define EMC230X_ALERT_DEVICE 0xffu
+
+// the most callbacks which can be registered on an alert handler
+#define EMC230X_ALERT_MAXCB 4
+
+// invoked from the alert task (not the ISR) with a fan index and a mask of
+// emc230x_event_bits. callbacks ought not block for long.
+typedef void (*emc230x_alert_cb)(emc230x* emc, unsigned fanidx,
+                                 unsigned events, void* arg);
+
+// watch gpio for ALERT from the count devices in emcs, which must remain
+// valid until emc230x_alert_stop(). on success, *alert is set and 0 is
+// returned. the GPIO ISR service is installed if necessary.
+int emc230x_alert_start(int gpio, emc230x* const* emcs, unsigned count,
+                        emc230x_alert** alert);
+
+// register a callback. at most EMC230X_ALERT_MAXCB can be registered, and
+// they cannot be removed. registration is not safe against concurrent
+// registration from another task.
+int emc230x_alert_add_callback(emc230x_alert* a, emc230x_alert_cb cb, void* arg);
+
+// remove the ISR, stop the alert task, and free the alert handler.
+void emc230x_alert_stop(emc230x_alert* a);
+
+
+// streaming statistics can be attached to a device, updated in constant
+// time and memory from every tach read the driver performs (through
+// emc230x_gettach(), emc230x_gettach_rpm(), emc230x_gettach_all(), or a
+// sampler). for each fan, they track the minimum, maximum, an
+// exponentially-weighted moving average, the mean and standard deviation
+// (via Welford's method), and a ring of the EMC230X_TACH_HISTORY most
+// recent decimated readings. all arithmetic is fixed point. updates must
+// come from a single task at a time, but snapshots can be taken from any
+// task without locking.
+typedef struct emc230x_tachstats emc230x_tachstats;
+
+// entries in each fan's decimated history ring.
+#define EMC230X_TACH_HISTORY 16
+
+typedef struct emc230x_tachstats_config {
+  // each sample is weighted 1 / 2^ewma_shift in the EWMA [1..8]. 0 for
+  // the default of 3.
+  unsigned ewma_shift;
+  // samples averaged into each history entry. 0 for the default of 8.
+  unsigned decimation;
+} emc230x_tachstats_config;
+
+typedef struct emc230x_tachsnap {
+  uint32_t samples;       // samples since attach or reset
+  uint16_t last_rpm;
+  uint16_t min_rpm;
+  uint16_t max_rpm;
+  uint16_t ewma_rpm;
+  uint16_t mean_rpm;
+  uint16_t stddev_rpm;    // sample standard deviation (jitter)
+  int32_t trend_rpm;      // newest history entry less the oldest
+} emc230x_tachsnap;
+
+// allocate and attach statistics to emc. cfg may be NULL for defaults.
+// returns non-zero if statistics are already attached.
+int emc230x_tachstats_attach(emc230x* emc, const emc230x_tachstats_config* cfg);
+
+// detach and free any statistics. emc230x_destroy() does this implicitly.
+void emc230x_tachstats_detach(emc230x* emc);
+
+// zero the statistics of all fans.
+void emc230x_tachstats_reset(emc230x* emc);
+
+// feed a tach count acquired elsewhere. the driver's own tach reads call
+// this; it is a no-op if no statistics are attached.
+void emc230x_tachstats_feed(const emc230x* emc, unsigned fanidx, unsigned tach);
+
+// summarize the statistics of the specified fan.
+int emc230x_tachstats_snapshot(const emc230x* emc, unsigned fanidx,
+                               emc230x_tachsnap* snap);
+
+// copy the specified fan's decimated history into rpm, oldest first,
+// setting *count to the number of valid entries.
+int emc230x_tachstats_history(const emc230x* emc, unsigned fanidx,
+                              uint16_t rpm[EMC230X_TACH_HISTORY], unsigned* count);
+
+// fan curves map temperature to PWM setting through a lookup table with an
+// entry for each whole degree Celsius from 0 through 255, so evaluation is
+// a single index. tables are built from piecewise-linear breakpoints with
+// emc230x_curve_build(), or can be generated ahead of time and declared
+// static const (placing them in flash). a curve set assigns curves to the
+// fans of a device, applies per-fan hysteresis, and writes PWM settings
+// only for fans whose output has changed.
+#define EMC230X_CURVE_ENTRIES 256
+
+typedef struct emc230x_curve_point {
+  unsigned temp_c;
+  uint8_t pwm;
+} emc230x_curve_point;
+
+typedef struct emc230x_curve {
+  uint8_t lut[EMC230X_CURVE_ENTRIES];   // indexed by degrees Celsius
+} emc230x_curve;
+
+// fill curve from count breakpoints, which must strictly ascend in
+// temperature. the output is held at the first (last) breakpoint's PWM
+// below (above) it, and linearly interpolated between breakpoints.
+int emc230x_curve_build(emc230x_curve* curve, const emc230x_curve_point* pts,
+                        unsigned count);
+
+// consider this struct to be opaque.
+typedef struct emc230x_curves {
+  const emc230x* emc;
+  const emc230x_curve* curves[EMC230X_MAXFANS];
+  uint8_t hysteresis[EMC230X_MAXFANS];
+  uint8_t temp[EMC230X_MAXFANS];        // temperature currently applied
+  uint8_t pwm[EMC230X_MAXFANS];         // PWM setting last written
+  unsigned valid;                       // mask of fans having been written
+} emc230x_curves;
+
+// prepare a curve set for emc, with no curves assigned.
+void emc230x_curves_init(emc230x_curves* cs, const emc230x* emc);
+
+// assign curve (which must remain valid while assigned) to the specified
+// fan, or unassign it with NULL. falling temperatures are only applied once
+// they've dropped hysteresis_c degrees below the temperature in effect.
+int emc230x_curves_assign(emc230x_curves* cs, unsigned fanidx,
+                          const emc230x_curve* curve, unsigned hysteresis_c);
+
+// evaluate each assigned fan's curve at its temperature in temps_c
+// (temperatures are clamped to 0..255), and write the PWM settings of any
+// fans whose output changed in a single emc230x_setpwm_all(). if written
+// is not NULL, it is set to the mask of fans written. returns non-zero on
+// a bus error, in which case the writes are retried upon the next update.
+int emc230x_curves_update(emc230x_curves* cs, const int temps_c[EMC230X_MAXFANS],
+                          unsigned* written);
+
+// the async API submits transactions to the ESP-IDF I2C driver and returns
+// immediately, allowing a task to keep several in flight alongside other
+// traffic on the bus. the bus must have been created with a non-zero
+// trans_queue_depth, and the device detected with emc230x_options.async_bus
+// set. any other emc230x on that bus must likewise be detected with
+// async_bus, and any other user of the bus must wait for its transactions
+// to complete. completions are delivered either to a callback, or
+// (when no callback is provided) to a queue, from which the result is
+// collected with emc230x_async_poll(). submissions must come from a single
+// task at a time.
+typedef struct emc230x_async emc230x_async;
+
+typedef enum {
+  EMC230X_ASYNC_GETTACH,
+  EMC230X_ASYNC_SETPWM,
+  EMC230X_ASYNC_READ_STATUS,
+} emc230x_async_op;
+
+typedef struct emc230x_async_result {
+  emc230x_async_op op;
+  unsigned fanidx;          // for EMC230X_ASYNC_GETTACH and _SETPWM
+  bool ok;                  // false if the transaction failed
+  unsigned tach;            // for EMC230X_ASYNC_GETTACH
+  emc230x_status status;    // for EMC230X_ASYNC_READ_STATUS
+} emc230x_async_result;
+
+// invoked from the I2C driver's ISR; it must not block.
+typedef void (*emc230x_async_cb)(const emc230x_async_result* result, void* arg);
+
+// prepare up to depth asynchronous operations in flight on emc, using a
+// second device handle on its bus, so that the synchronous API (which
+// remains usable) doesn't see their completions. fails unless emc was
+// detected with emc230x_options.async_bus.
+// on success, *async is set and 0 is returned.
+int emc230x_async_start(emc230x* emc, unsigned depth, emc230x_async** async);
+
+// submit a tach read, PWM write, or read of all status registers. returns
+// non-zero if depth operations are already in flight, or the driver
+// refused the transaction. cb may be NULL to queue the result instead.
+int emc230x_async_gettach(emc230x_async* a, unsigned fanidx,
+                          emc230x_async_cb cb, void* arg);
+int emc230x_async_setpwm(emc230x_async* a, unsigned fanidx, uint8_t pwm,
+                         emc230x_async_cb cb, void* arg);
+int emc230x_async_read_status(emc230x_async* a, emc230x_async_cb cb, void* arg);
+
+// retrieve the oldest completed result of an operation submitted without
+// a callback, waiting up to timeout_ms. at most depth uncollected results
+// are retained; any beyond that are dropped.
+int emc230x_async_poll(emc230x_async* a, emc230x_async_result* result,
+                       unsigned timeout_ms);
+
+// the number of operations submitted but not yet completed.
+unsigned emc230x_async_inflight(const emc230x_async* a);
+
+// wait up to timeout_ms for all operations in flight to complete, then free
+// the state. if some remain in flight (e.g. the bus is wedged), -1 is
+// returned and the state is left intact, since their completions would
+// refer to it; reset the bus and try again.
+int emc230x_async_stop(emc230x_async* a, unsigned timeout_ms);
+
+// an optional FreeRTOS task can own all writes to a device, so that several
+// tasks can change its settings without racing one another's
+// read-modify-write cycles, and without waiting on the bus. commands are
+// enqueued without blocking. the worker drains everything enqueued since
+// its last flush, keeping only the last value written to each register,
+// and flushes it with locked registers in a single configuration batch.
+// while the queue is running, the application must not otherwise write to
+// the device (reads remain safe).
+typedef struct emc230x_queue emc230x_queue;
+
+typedef enum {
+  EMC230X_CMD_SETPWM,       // fanidx, value: PWM setting [0..255]
+  EMC230X_CMD_TARGET_RPM,   // fanidx, value: target rpm
+  EMC230X_CMD_ENABLE_FSC,   // fanidx, value: bool
+  EMC230X_CMD_INTERRUPT,    // fanidx, value: bool
+  EMC230X_CMD_PWMPOLARITY,  // fanidx, value: bool
+  EMC230X_CMD_PWMOUTPUT,    // fanidx, value: bool
+  EMC230X_CMD_PWMBASEFREQ,  // fanidx, value: emc230x_base_freq
+  EMC230X_CMD_ALERTMASK,    // value: bool (fanidx is ignored)
+  EMC230X_CMD_WATCHDOG,     // value: bool (fanidx is ignored)
+} emc230x_cmd_op;
+
+typedef struct emc230x_cmd {
+  emc230x_cmd_op op;
+  unsigned fanidx;
+  unsigned value;
+} emc230x_cmd;
+
+// start a worker for emc with room for depth pending commands. emc must
+// remain valid until emc230x_queue_stop(). on success, *queue is set and 0
+// is returned.
+int emc230x_queue_start(emc230x* emc, unsigned depth, emc230x_queue** queue);
+
+// enqueue a command without blocking. returns non-zero if the command is
+// invalid, or the queue is full. safe to call from any task.
+int emc230x_queue_submit(emc230x_queue* q, const emc230x_cmd* cmd);
+
+// shorthand for submitting EMC230X_CMD_SETPWM.
+int emc230x_queue_setpwm(emc230x_queue* q, unsigned fanidx, uint8_t pwm);
+
+// wait up to timeout_ms (for each of enqueueing and flushing) until
+// everything previously submitted from this task has been written out.
+int emc230x_queue_sync(emc230x_queue* q, unsigned timeout_ms);
+
+// the number of commands and flushes which have failed since the queue
+// was started.
+unsigned emc230x_queue_errors(const emc230x_queue* q);
+
+// flush any pending commands, stop the worker, and free the queue.
+void emc230x_queue_stop(emc230x_queue* q);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,231 @@
+#ifndef DANKAMONGMEN_EMC230X_HPP
+#define DANKAMONGMEN_EMC230X_HPP
+
+// header-only C++ layer over the C API. the model is a template parameter,
+// so that fan indices given as template arguments are checked at compile
+// time, and batch calls take spans sized to the model's fans. everything
+// inlines to the underlying C call. the C library still validates its
+// arguments, as it is compiled separately. requires C++20 (std::span).
+//
+// this lives in namespace emc, since C++ doesn't allow a namespace to share
+// the name of the emc230x type.
+
+#include <cstdint>
+#include <span>
+#include "emc230x.h"
+
+namespace emc {
+
+// fans of the model which can be used, subject to CONFIG_EMC230X_MAX_FANS
+constexpr unsigned fan_count(emc230x_model model){
+  unsigned fans = 5;
+  switch(model){
+    case EMC2301: fans = 1; break;
+    case EMC2302_MODEL_UNSPEC:
+    case EMC2302_MODEL_1:
+    case EMC2302_MODEL_2: fans = 2; break;
+    case EMC2303: fans = 3; break;
+    case EMC2305: fans = 5; break;
+  }
+  return fans < EMC230X_MAXFANS ? fans : EMC230X_MAXFANS;
+}
+
+// whether the model was selected in Kconfig. a configuration lacking our
+// options supports every model, as does the C library.
+constexpr bool supported(emc230x_model model){
+#ifdef CONFIG_EMC230X_MAX_FANS
+  switch(model){
+    case EMC2301:
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2301
+      return true;
+#else
+      return false;
+#endif
+    case EMC2302_MODEL_UNSPEC:
+    case EMC2302_MODEL_1:
+    case EMC2302_MODEL_2:
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2302
+      return true;
+#else
+      return false;
+#endif
+    case EMC2303:
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2303
+      return true;
+#else
+      return false;
+#endif
+    case EMC2305:
+#ifdef CONFIG_EMC230X_SUPPORT_EMC2305
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+#else
+  (void)model;
+  return true;
+#endif
+}
+
+// register addresses, for use with the async API or a logic analyzer.
+// each fan has a block of 16 registers, starting at 0x30 for the first.
+namespace reg {
+  constexpr uint8_t configuration = 0x20;
+  constexpr uint8_t fanstatus = 0x24;
+  constexpr uint8_t softwarelock = 0xef;
+  constexpr uint8_t product = 0xfd;
+
+  constexpr uint8_t fan_base(unsigned fan){ return 0x30 + 16 * fan; }
+  constexpr uint8_t fan_setting(unsigned fan){ return fan_base(fan) + 0x0; }
+  constexpr uint8_t pwm_divide(unsigned fan){ return fan_base(fan) + 0x1; }
+  constexpr uint8_t fan_conf1(unsigned fan){ return fan_base(fan) + 0x2; }
+  constexpr uint8_t fan_conf2(unsigned fan){ return fan_base(fan) + 0x3; }
+  constexpr uint8_t tach_target_low(unsigned fan){ return fan_base(fan) + 0xc; }
+  // the reading is high byte first, unlike the target
+  constexpr uint8_t tach_read_high(unsigned fan){ return fan_base(fan) + 0xe; }
+  constexpr uint8_t tach_read_low(unsigned fan){ return fan_base(fan) + 0xf; }
+
+  static_assert(fan_setting(4) == 0x70 && tach_read_high(0) == 0x3e &&
+                tach_read_low(0) == 0x3f);
+}
+
+// a fan index checked against the model: either a compile-time constant
+// (make<I>()), or checked once at runtime (check()), after which it can be
+// used without further checks on our side.
+template<emc230x_model Model>
+class Fan {
+ public:
+  template<unsigned I>
+  static constexpr Fan make(){
+    static_assert(I < fan_count(Model), "fan index beyond the model's fans");
+    return Fan(I);
+  }
+
+  // returns false (leaving *f untouched) if idx is out of range
+  static constexpr bool check(unsigned idx, Fan* f){
+    if(idx >= fan_count(Model)){
+      return false;
+    }
+    *f = Fan(idx);
+    return true;
+  }
+
+  constexpr unsigned index() const { return idx_; }
+
+ private:
+  constexpr explicit Fan(unsigned idx) : idx_(idx) {}
+  unsigned idx_;
+};
+
+// owns a detected device of the given model, destroying it upon
+// destruction. detection can fail, and is thus a separate step (without
+// exceptions). a Device can be neither copied nor moved, since the C API
+// (samplers, groups, async state) holds pointers to the handle.
+template<emc230x_model Model>
+class Device {
+ public:
+  static_assert(supported(Model), "model not enabled in Kconfig");
+  static constexpr unsigned fans = fan_count(Model);
+  using fan = Fan<Model>;
+
+  Device() = default;
+  Device(const Device&) = delete;
+  Device& operator=(const Device&) = delete;
+
+  ~Device(){
+    if(detected_){
+      emc230x_destroy(&emc_);
+    }
+  }
+
+  // detect the device at address (zero for the model's default), using
+  // opts if provided. returns 0 on success.
+  int detect(i2c_master_bus_handle_t bus, uint8_t address = 0,
+             const emc230x_options* opts = nullptr){
+    if(detected_){
+      return -1;
+    }
+    const int r = opts ? emc230x_detect_opts(bus, Model, address, opts, &emc_)
+                       : emc230x_detect_at_address(bus, Model, address, &emc_);
+    detected_ = r == 0;
+    return r;
+  }
+
+  bool detected() const { return detected_; }
+
+  // the underlying handle, for the remainder of the C API
+  emc230x* get(){ return &emc_; }
+  const emc230x* get() const { return &emc_; }
+
+  template<unsigned I>
+  int setpwm(uint8_t pwm) const {
+    return setpwm(fan::template make<I>(), pwm);
+  }
+  int setpwm(fan f, uint8_t pwm) const {
+    return emc230x_setpwm(&emc_, f.index(), pwm);
+  }
+
+  template<unsigned I>
+  int getpwm(uint8_t& pwm) const {
+    return getpwm(fan::template make<I>(), pwm);
+  }
+  int getpwm(fan f, uint8_t& pwm) const {
+    return emc230x_getpwm(&emc_, f.index(), &pwm);
+  }
+
+  template<unsigned I>
+  int gettach(unsigned& tach) const {
+    return gettach(fan::template make<I>(), tach);
+  }
+  int gettach(fan f, unsigned& tach) const {
+    return emc230x_gettach(&emc_, f.index(), &tach);
+  }
+  template<unsigned I>
+  int gettach(unsigned& tach, bool fresh) const {
+    return gettach(fan::template make<I>(), tach, fresh);
+  }
+  int gettach(fan f, unsigned& tach, bool fresh) const {
+    return emc230x_gettach_opt(&emc_, f.index(), fresh, &tach);
+  }
+
+  template<unsigned I>
+  int gettach_rpm(unsigned& rpm) const {
+    return gettach_rpm(fan::template make<I>(), rpm);
+  }
+  int gettach_rpm(fan f, unsigned& rpm) const {
+    return emc230x_gettach_rpm(&emc_, f.index(), &rpm);
+  }
+
+  // the C API only touches the first fans entries of its arrays, so the
+  // spans need be no larger.
+  int gettach_all(std::span<unsigned, fans> tach) const {
+    return emc230x_gettach_all(&emc_, tach.data());
+  }
+  int gettach_all(std::span<unsigned, fans> tach, bool fresh) const {
+    return emc230x_gettach_all_opt(&emc_, fresh, tach.data());
+  }
+
+  // set the fans whose bits are set in mask (all of them by default)
+  int setpwm_all(std::span<const uint8_t, fans> pwm,
+                 unsigned mask = (1u << fans) - 1) const {
+    return emc230x_setpwm_all(&emc_, pwm.data(), mask);
+  }
+
+  int read_all_status(emc230x_status& status) const {
+    return emc230x_read_all_status(&emc_, &status);
+  }
+
+  emc230x_error last_error() const {
+    return emc230x_last_error(&emc_);
+  }
+
+ private:
+  emc230x emc_{};
+  bool detected_ = false;
+};
+
+}
+
+#endif